@@ -1,102 +1,171 @@
 #include <iostream>
 #include <fstream>
-#include <unordered_set>
+#include <vector>
+#include <array>
+#include <thread>
 #include <algorithm>
-#include <execution>
 #include <chrono>
 
 #include <common/field.hpp>
-#include <common/hash.hpp>
 #include <common/task.hpp>
 
-template<bool storeVisited>
-struct State {
-  State(Field& field, const Vector& position, const Vector& direction) : field(&field), position(position), direction(direction), obstaclePos(-1,-1) {}
-  State(const State<!storeVisited>& other) : field(other.field), position(other.position), direction(other.direction), obstaclePos(other.obstaclePos),
-    visited(other.visited), visitedObstacles(other.visitedObstacles), inLoop(other.inLoop) {}
+// Directions ordered clockwise (UP, RIGHT, DOWN, LEFT as rows increment downward), so a rotation of the guard is simply an increment
+const std::array<Vector, 4> Directions = { Vector(0, -1), Vector(1, 0), Vector(0, 1), Vector(-1, 0) };
 
-  enum class Result { LEFT_FIELD, IN_LOOP };
-  enum class Action { STEP, ROTATE };
+struct GuardState {
+  Vector position;
+  int direction; // index into Directions
+};
+
+/** Dense replacement for the set of (position, direction) states in which the guard hit an obstacle.
+ *  Each cell stores one bit per direction. Instead of clearing the arrays for every loop check, each cell also
+ *  remembers the generation in which its bits were written, so a reset is just an increment of the generation.
+ */
+struct TurnTracker {
+  TurnTracker(size_t cells) : generations(cells, 0), directions(cells, 0) {}
+
+  void reset() { ++generation; }
+
+  /** Marks the state as visited and returns false if it has already been marked in the current generation
+   */
+  bool mark(size_t offset, int direction) {
+    if (generations[offset] != generation) {
+      // bits are from an older check -> treat them as cleared
+      generations[offset] = generation;
+      directions[offset] = 0;
+    }
+
+    uint8_t bit = 1 << direction;
+    if (directions[offset] & bit) {
+      return false;
+    }
+    directions[offset] |= bit;
+    return true;
+  }
 
+  uint32_t generation = 1;
+  std::vector<uint32_t> generations;
+  std::vector<uint8_t> directions;
+};
 
-  Result run() {
-    do {
-      nextStep();
-    } while (!leftField() && !stuckInLoop());
 
-    return leftField() ? Result::LEFT_FIELD : Result::IN_LOOP;
+struct Patrol {
+  Patrol(const Field& field) : field(field), visited(field.data.size(), false) {
+    start.position = field.fromOffset(field.findOffset('^'));
+    start.direction = 0; // start direction is UP
   }
 
-  
-  void nextStep() {
-    if constexpr (storeVisited) { 
-      // only needed for first run -> so just don't do it for the obstacle checks as this is actually quite expensive
-      visited.insert(position);
+  // Part 1: Walk the original route and remember the state right before the guard enters each cell for the first time
+  void walk() {
+    GuardState state = start;
+    visited[field.toOffset(state.position)] = true;
+
+    for (;;) {
+      auto nextPosition = state.position + Directions[state.direction];
+      if (!field.validPosition(nextPosition)) {
+        return; // left the field
+      }
+
+      auto nextOffset = field.toOffset(nextPosition);
+      if (field.data[nextOffset] == '#') {
+        state.direction = (state.direction + 1) % 4;
+        continue;
+      }
+
+      if (!visited[nextOffset]) {
+        visited[nextOffset] = true;
+        firstVisits.emplace_back(nextOffset, state);
+      }
+      state.position = nextPosition;
     }
+  }
+
+  /** Continue the walk from the given state with an additional obstacle and check whether the guard gets stuck in a loop.
+   *  The history before the given state doesn't need to be replayed. The obstacle cell has not been entered before, so
+   *  that part of the path is unchanged and if the guard ever returns to it, it will already be in a loop, which we
+   *  detect on the next obstacle it hits.
+   */
+  bool loopsWithObstacle(GuardState state, size_t obstacleOffset, TurnTracker& turns) const {
+    turns.reset();
+
+    for (;;) {
+      auto nextPosition = state.position + Directions[state.direction];
+      if (!field.validPosition(nextPosition)) {
+        return false; // left the field
+      }
 
-    auto nextPosition = position + direction;
-    if (field->validPosition(nextPosition) && ((*field)[nextPosition] == '#' || nextPosition == obstaclePos)) {
-      // obstacle in front -> rotate
-      if (!visitedObstacles.emplace(position, direction).second) {
-        inLoop = true;
+      auto nextOffset = field.toOffset(nextPosition);
+      if (field.data[nextOffset] == '#' || nextOffset == obstacleOffset) {
+        // obstacle in front -> rotate
+        if (!turns.mark(field.toOffset(state.position), state.direction)) {
+          return true; // hit this obstacle from the same direction before
+        }
+        state.direction = (state.direction + 1) % 4;
+      } else {
+        // continue moving in that direction
+        state.position = nextPosition;
       }
-      direction = direction.rotateCW();
-    } else {
-      // continue moving in that direction
-      position = nextPosition;
     }
   }
 
-  bool leftField() const { return !field->validPosition(position); }
-  bool stuckInLoop() const { return inLoop; }
+  // Part 2: Try an obstacle on every visited cell [except for the start position] and count the ones causing a loop
+  size_t countLoopObstacles() const {
+    const size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    // Each thread gets its own result vector and turn tracker, so no synchronization is needed except for the final join
+    std::vector<std::vector<size_t/*offset*/>> loopObstacles(threadCount);
+    std::vector<std::thread> threads;
+    for (size_t threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+      threads.emplace_back([this, threadIndex, threadCount, &loopObstacles]() {
+        TurnTracker turns(field.data.size());
+        // interleave the candidates as the walk length varies a lot along the route
+        for (size_t i = threadIndex; i < firstVisits.size(); i += threadCount) {
+          auto& [offset, state] = firstVisits[i];
+          if (loopsWithObstacle(state, offset, turns)) {
+            loopObstacles[threadIndex].push_back(offset);
+          }
+        }
+      });
+    }
 
-  Field* field;
-  std::unordered_set<Vector> visited;
-  std::unordered_set<std::pair<Vector/*pos*/, Vector/*direction*/>> visitedObstacles;
-  Vector position;
-  Vector direction;
-  Vector obstaclePos; // additional obstacle (used to check multiple potential obstacles in parallel without modifying the field)
-  bool inLoop = false;
+    size_t count = 0;
+    for (size_t threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+      threads[threadIndex].join();
+      count += loopObstacles[threadIndex].size();
+    }
+    return count;
+  }
+
+  size_t visitedCount() const {
+    return firstVisits.size() + 1; // + start position
+  }
+
+
+  const Field& field;
+  GuardState start;
+  std::vector<bool> visited;
+  std::vector<std::pair<size_t/*offset*/, GuardState/*before entering*/>> firstVisits;
 };
 
 int main() {
   auto t1 = std::chrono::high_resolution_clock::now();
 
   Field field(task::input());
-  
-  auto startPosition = field.fromOffset(field.findOffset('^'));
-
-  
-  const State<false> startState(field, startPosition, Vector(0, -1)); // start direction is UP as rows increment downward
-  State<true> firstRun(startState);
-  firstRun.run();
-  
+  Patrol patrol(field);
+  patrol.walk();
+
   // Part2 : At each visited position [except for the start position] try adding an obstacle and check whether this causes a loop
-  //         My first attempt at putting these obstacles in the way as we walk had the flaw that putting the obstacle late into the
-  //         journey could prevent the guard from even reaching that point.
-  //         This is pretty brute force, but I cannot think of a better solution for now
-  std::unordered_set<Vector> possibleLoops;
-  std::mutex m;
-
-
-  // Parellelized solution as original takes 5.2 seconds, parallel one takes 1.1 seconds (or 780ms without debugger)
-  // Reduced further down to 2,5s or 0,5s (parallel) by only storing the obstacle orientations for loop detection
-  // Further optimized down to 195ms or 45ms (parallel) by not storing visited states at all when performing obstacle loop checks
-  std::for_each(std::execution::par, firstRun.visited.begin(), firstRun.visited.end(), [&](Vector position) {
-    if (position != startPosition) {
-      State<false> state(startState);
-      state.obstaclePos = position;
-      if (state.run() == State<false>::Result::IN_LOOP) {
-        std::lock_guard<std::mutex> guard(m); // synchronize access to set!
-        possibleLoops.insert(position);
-      }
-    }
-  });
+  //         Putting the obstacle late into the journey could prevent the guard from even reaching that point, which is why we only
+  //         consider the first time the guard enters each cell and resume from the state right before that.
+  //
+  // Original solution took 5.2 seconds, parallel one 1.1 seconds. Only storing obstacle orientations got it down to 45ms (parallel).
+  // Replacing the hash sets with dense bit arrays and resuming the walk instead of replaying it from the start cuts this further.
+  auto loopObstacles = patrol.countLoopObstacles();
 
   auto t2 = std::chrono::high_resolution_clock::now();
 
-  std::cout << "Part 1: " << firstRun.visited.size() << "\n";
-  std::cout << "Part 2: " << possibleLoops.size() << "\n";
+  std::cout << "Part 1: " << patrol.visitedCount() << "\n";
+  std::cout << "Part 2: " << loopObstacles << "\n";
 
   std::cout << "Time " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << "ms\n";
 }
@@ -2,12 +2,75 @@
 #include <fstream>
 #include <vector>
 #include <unordered_map>
-#include <unordered_set>
+#include <numeric>
+#include <thread>
+#include <algorithm>
+#include <bit>
 #include <chrono>
 
 #include <common/field.hpp>
 #include <common/task.hpp>
 
+/** Dense bitmap of antinode positions with one bit per field position
+ */
+struct AntiNodeMap {
+  AntiNodeMap(const Field& field) : field(&field), bits((field.data.size() + 63) / 64, 0) {}
+
+  void mark(const Vector& position) {
+    auto offset = field->toOffset(position);
+    bits[offset / 64] |= uint64_t(1) << (offset % 64);
+  }
+
+  AntiNodeMap& operator|=(const AntiNodeMap& other) {
+    for (size_t i = 0; i < bits.size(); ++i) {
+      bits[i] |= other.bits[i];
+    }
+    return *this;
+  }
+
+  size_t count() const {
+    size_t result = 0;
+    for (auto word : bits) {
+      result += std::popcount(word);
+    }
+    return result;
+  }
+
+  const Field* field;
+  std::vector<uint64_t> bits;
+};
+
+
+/** Marks the antinodes of all antenna pairs of a single frequency
+ */
+void markAntiNodes(const Field& field, const std::vector<Vector>& positions, AntiNodeMap& antiNodes, AntiNodeMap& allAntiNodes) {
+  for (size_t i = 0; i < positions.size(); ++i) {
+    for (size_t j = i + 1; j < positions.size(); ++j) {
+      auto pos1 = positions[i];
+      auto pos2 = positions[j];
+
+      // Part 1: simply add the vector from 1->2 onto 2 (and 2->1 onto 1) to get to the antinode positions
+      auto distance = pos2 - pos1;
+      for (auto nodePos : { pos2 + distance, pos1 - distance }) {
+        if (field.validPosition(nodePos)) {
+          antiNodes.mark(nodePos);
+        }
+      }
+
+      // Part 2: every grid position on the line through both antennas is an antinode. The line can only hit grid positions
+      //         in steps of the distance divided by the gcd of its components (i.e. "..a....a.." also contains the points in between)
+      auto step = distance / std::gcd(distance.x, distance.y);
+      for (auto nodePos = pos1; field.validPosition(nodePos); nodePos += step) {
+        allAntiNodes.mark(nodePos);
+      }
+      for (auto nodePos = pos1 - step; field.validPosition(nodePos); nodePos -= step) {
+        allAntiNodes.mark(nodePos);
+      }
+    }
+  }
+}
+
+
 int main()
 {
   auto t1 = std::chrono::high_resolution_clock::now();
@@ -22,47 +85,37 @@ int main()
       antennas[freq].push_back(field.fromOffset(offset));
     }
   }
-
-  // Not very efficient, but straight forward
-  std::unordered_set<Vector> antiNodes;
+  std::vector<const std::vector<Vector>*> frequencies;
   for (auto& freqEntry : antennas) {
-    // For now just check all possible combinations
-    for (auto pos1 : freqEntry.second) {
-      for (auto pos2 : freqEntry.second) {
-        if (pos1 != pos2) {
-          auto nodePos = pos2 + (pos2 - pos1); // simply add the vector from 1->2 onto 2 to get to the antinode position
-          if (field.validPosition(nodePos)) {
-            antiNodes.insert(nodePos);
-          }
-        }
-      }
-    }
+    frequencies.push_back(&freqEntry.second);
   }
 
-  // Part2: 
-  std::unordered_set<Vector> allAntiNodes;
-  for (auto& freqEntry : antennas) {
-    // For now just check all possible combinations
-    for (auto pos1 : freqEntry.second) {
-      for (auto pos2 : freqEntry.second) {
-        if (pos1 != pos2) {
-          // Apparently the field is designed in a way that we don't need to normalize the 
-          // direction vector to the minimum valid distance... (i.e. it doesn't contain constellations like: "..a....a..")
-          auto direction = pos2 - pos1; // 1->2
-          auto nodePos = pos1;
-          for (auto nodePos = pos1; field.validPosition(nodePos); nodePos += direction) {
-            allAntiNodes.insert(nodePos);
-          }
-        }
+  // Frequencies are independent of each other, so each thread marks the antinodes of its frequencies in its own
+  // bitmaps, which are merged afterwards.
+  const size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<AntiNodeMap> antiNodes(threadCount, AntiNodeMap(field));
+  std::vector<AntiNodeMap> allAntiNodes(threadCount, AntiNodeMap(field));
+  std::vector<std::thread> threads;
+  for (size_t threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+    threads.emplace_back([&, threadIndex]() {
+      for (size_t i = threadIndex; i < frequencies.size(); i += threadCount) {
+        markAntiNodes(field, *frequencies[i], antiNodes[threadIndex], allAntiNodes[threadIndex]);
       }
-    }
+    });
   }
 
+  for (size_t threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+    threads[threadIndex].join();
+    if (threadIndex > 0) {
+      antiNodes[0] |= antiNodes[threadIndex];
+      allAntiNodes[0] |= allAntiNodes[threadIndex];
+    }
+  }
 
 
   auto t2 = std::chrono::high_resolution_clock::now();
 
-  std::cout << "Part1: " << antiNodes.size() << "\n";
-  std::cout << "Part2: " << allAntiNodes.size() << "\n";
+  std::cout << "Part1: " << antiNodes[0].count() << "\n";
+  std::cout << "Part2: " << allAntiNodes[0].count() << "\n";
   std::cout << "Time " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << "ms\n";
 }
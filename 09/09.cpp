@@ -1,167 +1,230 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <list>
+#include <vector>
+#include <array>
+#include <queue>
 #include <algorithm>
+#include <functional>
+#include <cctype>
 #include <chrono>
 
 #include <common/task.hpp>
 
-struct Block {
-  Block() : id(Block::FREE), size(0) {}
-  Block(int id, int size) : id(id), size(size) {}
-
-  int id; // max id is 9999, so we just as well use an int16_t
+/** A contiguous range of blocks on the disk
+ */
+struct Span {
+  int64_t offset;
   int size;
-  
-  static const int FREE = -1;
 
-  bool isFree() const { return id == Block::FREE;  }
+  // ordered by offset first to find the leftmost span in the free span heaps
+  auto operator<=>(const Span& other) const = default;
 };
 
+/** Checksum of a file span, which is the sum of offset * id over all its blocks.
+ *  Uses the arithmetic series sum instead of adding up each block separately.
+ */
+int64_t spanChecksum(int64_t id, int64_t offset, int64_t size) {
+  return id * (size * offset + size * (size - 1) / 2);
+}
+
+
+/** Reads the digits of the disk map in chunks from a seekable stream, either front to back or back to front.
+ *  Two of these on the same stream allow consuming the map from both ends without holding more than two chunks in memory.
+ */
+struct DigitReader {
+  static constexpr int64_t CHUNK_SIZE = 1 << 16;
 
+  DigitReader(std::istream& input, int64_t begin, int64_t end, bool reverse) : input(&input), begin(begin), end(end), reverse(reverse) {}
 
-auto nextFreeBlock(std::list<Block>::iterator pos, std::list<Block>::iterator end) {
-  if (pos == end) {
-    return end;
+  int next() {
+    if (bufferPos == buffer.size()) {
+      refill();
+    }
+    return buffer[bufferPos++] - '0';
   }
 
-  if (pos->isFree()) {
-    return pos; // current position is at a free block
+private:
+  void refill() {
+    auto size = std::min(CHUNK_SIZE, end - begin);
+    buffer.resize(size);
+    input->clear();
+    input->seekg(reverse ? end - size : begin);
+    input->read(buffer.data(), size);
+
+    if (reverse) {
+      std::ranges::reverse(buffer);
+      end -= size;
+    } else {
+      begin += size;
+    }
+    bufferPos = 0;
   }
 
-  return std::find_if(pos, end, [](const Block& block) { return block.isFree(); });
-}
+  std::istream* input;
+  int64_t begin, end; // range of digits not yet read into the buffer
+  bool reverse;
+  std::string buffer;
+  size_t bufferPos = 0;
+};
 
 
+/** Part 1 without building any block structure: Reads the disk map from the front and fills each gap
+ *  with blocks of the files read from the back, which handles disk maps of any size.
+ */
+int64_t streamCompactBlocks(std::istream&& input) {
+  input.seekg(0, std::ios::end);
+  int64_t length = input.tellg();
+  for (char ch; length > 0; --length) {
+    // ignore trailing line breaks
+    input.seekg(length - 1);
+    if (input.get(ch) && std::isdigit(ch)) {
+      break;
+    }
+  }
+  if (length == 0) {
+    return 0;
+  }
 
-int main()
-{
-  auto t1 = std::chrono::high_resolution_clock::now();
+  // digits alternate between file and gap sizes, so files are at the even indices
+  int64_t lastFile = (length - 1) & ~int64_t(1);
+  DigitReader front(input, 0, length, false);
+  DigitReader back(input, 0, lastFile + 1, true);
 
-  std::list<Block> blocks;
-  {
-    int nextBlockId = 0;
-    bool freeBlock = false;
-    auto file = task::input();
-    for (char sizeCh; file >> sizeCh; freeBlock = !freeBlock) {
-      int blockSize = sizeCh - '0'; // 0-9
-      if (freeBlock) {
-        if (blockSize > 0) { // don't insert empty blocks
-          if (blocks.back().isFree()) {
-            // Simply grow the last free block to avoid the overhead of merging them later 
-            blocks.back().size += blockSize;
-          } else {
-            blocks.emplace_back(Block::FREE, blockSize);
-          }
-        }
-      } else {
-        if (blockSize > 0) { // don't insert empty blocks
-          blocks.emplace_back(nextBlockId, blockSize);
+  int64_t checksum = 0;
+  int64_t offset = 0;
+  int remaining = back.next(); // blocks of the last file, which have not been moved yet
+  int64_t index = 0;
+  for (; index < lastFile; ++index) {
+    int size = front.next();
+    if (index % 2 == 0) {
+      // The file stays where it is
+      checksum += spanChecksum(index / 2, offset, size);
+      offset += size;
+      continue;
+    }
+
+    // Fill the gap with the trailing blocks of the last files
+    while (size > 0 && index < lastFile) {
+      auto movedData = std::min(size, remaining);
+      checksum += spanChecksum(lastFile / 2, offset, movedData);
+      offset += movedData;
+      size -= movedData;
+      remaining -= movedData;
+      if (remaining == 0) {
+        // file has been completely moved -> continue with the one before (skipping the gap in between)
+        lastFile -= 2;
+        if (index < lastFile) {
+          back.next();
+          remaining = back.next();
         }
-        ++nextBlockId;
       }
     }
   }
 
+  if (index == lastFile) {
+    // we reached the file we are currently moving from the front -> only its first blocks are left
+    checksum += spanChecksum(lastFile / 2, offset, remaining);
+  }
 
-  auto blocksCopy = blocks; // copy instead of re-reading for part2
+  return checksum;
+}
 
 
-  // Part 1: 
-  // Now compact the data by finding the first free block and fill it with the data from the last data block
-  auto freeBlockPos = blocks.begin();
-
-  while ((freeBlockPos = nextFreeBlock(freeBlockPos, blocks.end())) != blocks.end()) {
-    auto dataBlockPos = --(blocks.end());
-    while (dataBlockPos->isFree()) {
-      // delete trailing free blocks
-      auto eraseBlockPos = dataBlockPos;
-      --dataBlockPos;
-      blocks.erase(eraseBlockPos);
-    }
+struct Disk {
+  Disk(std::istream&& input) {
+    std::string diskMap;
+    std::getline(input, diskMap);
 
-    auto movedData = std::min(freeBlockPos->size, dataBlockPos->size);
-    if (movedData < freeBlockPos->size) {
-      // We must insert a new data block before the free block. The current data block is completely moved.
-      freeBlockPos->size -= movedData;
-      blocks.insert(freeBlockPos, *dataBlockPos);
-      blocks.erase(dataBlockPos);
-    } else {
-      // Data is partially or completely moved, the free block is completely consumed by the data
-      // We only need to copy id, as the size of the free block cannot grow here
-      freeBlockPos->id = dataBlockPos->id; 
-      if (dataBlockPos->size > movedData) {
-        // data block shrinks by the moved data
-        dataBlockPos->size -= movedData;
+    int64_t offset = 0;
+    bool freeBlock = false;
+    for (auto sizeCh : diskMap) {
+      if (!std::isdigit(sizeCh)) {
+        continue; // skip a trailing '\r'
+      }
+
+      int blockSize = sizeCh - '0'; // 0-9
+      if (freeBlock) {
+        gaps.back().size = blockSize;
       } else {
-        // data block has been completely moved
-        blocks.erase(dataBlockPos);
+        // the file's id is its index, each file is followed by a (possibly empty) gap
+        files.push_back({ offset, blockSize });
+        gaps.push_back({ offset + blockSize, 0 });
       }
+      offset += blockSize;
+      freeBlock = !freeBlock;
     }
   }
 
-  // Now count up the checksum
-  int64_t checksum = 0;
-  int offset = 0;
-  for (auto& block : blocks) {
-    // There are no free blocks left in the list, so no problem here
-    for (auto endOffset = offset + block.size; offset != endOffset; ++offset) {
-      // idk why the number is considered huge... it easily fits into 64-Bit int
-      checksum += offset * block.id;
+  // Part 2: Move each file (starting with the last) into the leftmost gap, which can hold the whole file
+  int64_t compactFiles() const {
+    // One min-heap of gap offsets per gap size. This way the leftmost fitting gap is simply the minimum over the
+    // tops of all heaps with a size >= file size. Files are at most 9 blocks, so all larger gaps go into the last heap.
+    std::array<std::priority_queue<Span, std::vector<Span>, std::greater<>>, 10> freeSpans;
+    for (size_t i = 0; i < gaps.size(); ++i) {
+      auto gap = gaps[i];
+      // Gaps next to empty files are adjacent and must be merged
+      while (i + 1 < gaps.size() && gap.offset + gap.size == gaps[i + 1].offset) {
+        gap.size += gaps[++i].size;
+      }
+      if (gap.size > 0) {
+        freeSpans[std::min(gap.size, 9)].push(gap);
+      }
     }
-  }
 
+    int64_t checksum = 0;
+    for (int id = static_cast<int>(files.size()) - 1; id >= 0; --id) {
+      auto file = files[id];
 
-  // Part 2: For the second part we need to invert the iteration process
-  //         We start by finding the last not yet processed file block and then search for a free space to insert it into
-  blocks = std::move(blocksCopy);
-  
-  // By terminating on blocks.begin() we may attempt to move already moved blocks, but since each block is moved to the first fitting position
-  // there will be no free block where we could move the already moved block into.
-  for (auto nextDataBlockPos = --(blocks.end()); nextDataBlockPos != blocks.begin(); --nextDataBlockPos) {
-    auto& block = *nextDataBlockPos;
-    if (!block.isFree()) {
-      // skip free blocks, here we cannot delete them, because there is no guarantee that we would actually use them
-      auto blockSize = nextDataBlockPos->size;
-      auto freeBlockPos = std::find_if(blocks.begin(), nextDataBlockPos, [=](const Block& block) { return block.isFree() && block.size >= blockSize; });
-      if (freeBlockPos != nextDataBlockPos) {
-        // we can actually move the whole file
-        if (freeBlockPos->size > blockSize) {
-          // we must insert the data block before this free block and reduce the free block's size
-          blocks.insert(freeBlockPos, *nextDataBlockPos);
-          freeBlockPos->size -= blockSize;
-        } else {
-          // Free block size matches exactly
-          *freeBlockPos = *nextDataBlockPos;
+      // Find the leftmost gap, which is left of the file and can hold it
+      int bestSize = 0;
+      for (int size = std::max(file.size, 1); size < 10; ++size) {
+        if (!freeSpans[size].empty() && freeSpans[size].top().offset < file.offset &&
+            (bestSize == 0 || freeSpans[size].top().offset < freeSpans[bestSize].top().offset)) {
+          bestSize = size;
         }
+      }
 
-        // we DO NOT erase the just moved block because there may be data following it and this would lead to wrong offsets
-        nextDataBlockPos->id = Block::FREE; // the size doesn't change
+      if (bestSize != 0) {
+        // Move the file to the start of the gap and put the rest of the gap back into the heap matching its size.
+        // The space freed up by the file doesn't need to be tracked as all files left to move are in front of it.
+        auto gap = freeSpans[bestSize].top();
+        freeSpans[bestSize].pop();
+        file.offset = gap.offset;
+        gap.offset += file.size;
+        gap.size -= file.size;
+        if (gap.size > 0) {
+          freeSpans[std::min(gap.size, 9)].push(gap);
+        }
       }
+
+      checksum += spanChecksum(id, file.offset, file.size);
     }
 
-    // continue with next block
+    return checksum;
   }
 
 
-  // Now count up the checksum
-  int64_t checksum2 = 0;
-  offset = 0;
-  for (auto& block : blocks) {
-    // We must handle free blocks correctly
-    if (block.isFree()) {
-      offset += block.size;
-    } else {
-      for (auto endOffset = offset + block.size; offset != endOffset; ++offset) {
-        // idk why the number is considered huge... it easily fits into 64-Bit int
-        checksum2 += offset * block.id;
-      }
-    }
-  }
+  std::vector<Span> files; // indexed by file id
+  std::vector<Span> gaps;  // gaps[id] is the free space following files[id]
+};
 
 
 
+int main()
+{
+  auto t1 = std::chrono::high_resolution_clock::now();
+
+  // Part 1: 
+  // Replaced the std::list<Block> based compaction, which moved blocks around until no free block was left,
+  // by directly calculating the checksum of each moved span while reading the disk map from both ends.
+  auto checksum = streamCompactBlocks(task::input());
+
+  // Part 2: Searching the first fitting gap by iterating over all blocks for each file was quadratic,
+  //         with a heap per gap size we find it in O(log n).
+  Disk disk(task::input());
+  auto checksum2 = disk.compactFiles();
+
 
   auto t2 = std::chrono::high_resolution_clock::now();
 
@@ -2,83 +2,187 @@
 #include <fstream>
 #include <algorithm>
 #include <chrono>
-#include <queue>
-#include <ranges>
-#include <set>
+#include <array>
+#include <vector>
+#include <bit>
+#include <execution>
 
 #include <common/field.hpp>
 #include <common/task.hpp>
 
-struct MapElement {
-  MapElement(char ch) : height(ch) {}
+/** Fixed size bitset with one bit per summit. Used as long as the number of summits is small.
+ */
+struct DenseSummitSet {
+  DenseSummitSet(int summitCount) : words((summitCount + 63) / 64, 0) {}
 
-  int8_t height; // as ASCII char
-  std::vector<int/*offset*/> reachableTops; // here we collect all reachable tops (with duplicates), which we will later filter out
+  void insert(int summit) {
+    words[summit / 64] |= uint64_t(1) << (summit % 64);
+  }
+
+  void merge(const DenseSummitSet& other) {
+    for (size_t i = 0; i < words.size(); ++i) {
+      words[i] |= other.words[i];
+    }
+  }
+
+  int size() const {
+    int count = 0;
+    for (auto word : words) {
+      count += std::popcount(word);
+    }
+    return count;
+  }
+
+  std::vector<uint64_t> words;
 };
 
-std::ostream& operator<<(std::ostream& out, const MapElement& element) {
-  out << std::setfill(' ') << std::setw(2) << element.reachableTops.size() << ' ';
-  return out;
-}
 
+/** Bitset, which only stores the non-zero words ordered by their index. A cell can only reach the summits within 9 steps,
+ *  which only ever covers a handful of words, so the memory doesn't grow with the total number of summits on large maps.
+ */
+struct SparseSummitSet {
+  SparseSummitSet(int /*summitCount*/) {} // same interface as DenseSummitSet, nothing to preallocate
 
+  void insert(int summit) {
+    // only called for summits, which reach nothing but themselves
+    words.emplace_back(summit / 64, uint64_t(1) << (summit % 64));
+  }
 
-int main() {
-  auto t1 = std::chrono::high_resolution_clock::now();
-  FieldT<MapElement> field(task::input());
+  void merge(const SparseSummitSet& other) {
+    std::vector<std::pair<int/*index*/, uint64_t/*word*/>> merged;
+    merged.reserve(words.size() + other.words.size());
 
-  // We collect the nodes to process in a queue to ensure we will first process all '9', then all '8', ... that way
-  // we never have to update any trailhead values for other numbers than the current processed one
+    auto it = words.cbegin();
+    auto otherIt = other.words.cbegin();
+    while (it != words.cend() || otherIt != other.words.cend()) {
+      if (otherIt == other.words.cend() || (it != words.cend() && it->first < otherIt->first)) {
+        merged.push_back(*(it++));
+      } else if (it == words.cend() || otherIt->first < it->first) {
+        merged.push_back(*(otherIt++));
+      } else {
+        merged.emplace_back(it->first, it->second | otherIt->second);
+        ++it;
+        ++otherIt;
+      }
+    }
+    words = std::move(merged);
+  }
 
-  std::queue<int/*offset*/> toProcess;
-  // Part1: First collect all '9' elements into the toProcess queue and then process each one of them
-  for (int offset = 0; offset < field.data.size(); ++offset) {
-    if (field.data[offset].height == '9') { // since we must reach a '9' we are only interested in paths, which end at '9'
-      field.data[offset].reachableTops.push_back(offset); // initialize: only this top is reachable
-      toProcess.push(offset);
+  int size() const {
+    int count = 0;
+    for (auto& [index, word] : words) {
+      count += std::popcount(word);
     }
+    return count;
   }
 
-  // Now keep processing until all reachable nodes have been processed
-  while (!toProcess.empty()) {
-    auto nodePosition = field.fromOffset(toProcess.front());
-    toProcess.pop();
+  std::vector<std::pair<int/*index*/, uint64_t/*word*/>> words;
+};
+
+
+
+struct TopographicMap : public Field {
+  TopographicMap(std::istream&& input) : Field(input), levelIndex(data.size(), -1) {
+    // Group all cells by their height. Since the trails only ever go up by one, processing the cells level by level
+    // from the top ensures that the values of the level above are final once we get to a cell.
+    // Impassable cells (e.g. '.' in the examples) are in no level and never part of a trail.
+    for (int offset = 0; offset < data.size(); ++offset) {
+      if (data[offset] < '0' || data[offset] > '9') {
+        continue;
+      }
+      auto& level = levels[data[offset] - '0'];
+      levelIndex[offset] = static_cast<int>(level.size());
+      level.push_back(offset);
+    }
+  }
 
-    // Expand the current node by checking all directions
-    auto& currentNode = field[nodePosition];
+  /** Calls func(neighborOffset) for each neighbor of offset, which is exactly one higher
+   */
+  template<typename Func>
+  void forEachUphillNeighbor(int offset, Func&& func) const {
+    auto position = fromOffset(offset);
     for (auto direction : Vector::AllSimpleDirections()) {
-      auto nextPosition = nodePosition + direction;
-      if (field.validPosition(nextPosition)) {
-        // We can expand in that direction
-        auto& nextNode = field[nextPosition];
-        if (nextNode.height == currentNode.height-1) {
-          // a valid trail continuation
-          if (!nextNode.reachableTops.empty()) {
-            // already expanded there by another node
-            nextNode.reachableTops.insert(nextNode.reachableTops.end(), currentNode.reachableTops.begin(), currentNode.reachableTops.end());
-          } else {
-            // node not yet expanded and into processing queue
-            nextNode.reachableTops = currentNode.reachableTops;
-            toProcess.push(field.toOffset(nextPosition));
-          }
-        }
+      auto nextPosition = position + direction;
+      if (validPosition(nextPosition) && (*this)[nextPosition] == data[offset] + 1) {
+        func(static_cast<int>(toOffset(nextPosition)));
       }
     }
   }
 
+  // Part 1: Count the distinct summits reachable from each trailhead.
+  //         Each cell merges the summit sets of its uphill neighbors, so only the sets of two levels are needed at once.
+  //         A cell only writes its own set and only reads the finished level above, so each level is processed in parallel.
+  template<typename SummitSet>
+  int64_t countReachableSummits() const {
+    const int summitCount = static_cast<int>(levels[9].size());
 
+    std::vector<SummitSet> upperLevel(summitCount, SummitSet(summitCount));
+    for (int summit = 0; summit < summitCount; ++summit) {
+      upperLevel[summit].insert(summit); // summits are indexed by their position in the level
+    }
+
+    for (int height = 8; height >= 0; --height) {
+      std::vector<SummitSet> currentLevel(levels[height].size(), SummitSet(summitCount));
+      std::for_each(std::execution::par, levels[height].begin(), levels[height].end(), [&](int offset) {
+        auto& summits = currentLevel[levelIndex[offset]];
+        forEachUphillNeighbor(offset, [&](int nextOffset) {
+          summits.merge(upperLevel[levelIndex[nextOffset]]);
+        });
+      });
+      upperLevel = std::move(currentLevel);
+    }
+
+    int64_t sum = 0;
+    for (auto& summits : upperLevel) {
+      sum += summits.size();
+    }
+    return sum;
+  }
+
+  int64_t countReachableSummits() const {
+    // dense bitsets are faster, but their size grows with the number of summits
+    return (levels[9].size() <= 4096) ? countReachableSummits<DenseSummitSet>() : countReachableSummits<SparseSummitSet>();
+  }
+
+  // Part 2: Count the distinct trails from each trailhead. The number of trails from a cell is the sum of the
+  //         trails from its uphill neighbors (again pulled from the level above in parallel).
+  int64_t countTrails() const {
+    std::vector<int64_t> trails(data.size(), 0);
+    for (auto offset : levels[9]) {
+      trails[offset] = 1;
+    }
+
+    for (int height = 8; height >= 0; --height) {
+      std::for_each(std::execution::par, levels[height].begin(), levels[height].end(), [&](int offset) {
+        forEachUphillNeighbor(offset, [&](int nextOffset) {
+          trails[offset] += trails[nextOffset];
+        });
+      });
+    }
 
-  // Now we simply need to sum up the trailHeads values in all '0' nodes
-  int allHeadSum = 0;
-  int uniqueHeadSum = 0;
-  for (auto& node : field.data) {
-    if (node.height == '0') {
-      // Now we can determine the reachable heads with duplicates and without.
-      allHeadSum += node.reachableTops.size();
-      uniqueHeadSum += (node.reachableTops | std::ranges::to<std::set>()).size();
+    int64_t sum = 0;
+    for (auto offset : levels[0]) {
+      sum += trails[offset];
     }
+    return sum;
   }
-  
+
+
+  std::array<std::vector<int/*offset*/>, 10> levels; // cells grouped by height
+  std::vector<int> levelIndex; // index of each cell within its level
+};
+
+
+
+int main() {
+  auto t1 = std::chrono::high_resolution_clock::now();
+  TopographicMap map(task::input());
+
+  // Collecting all reachable tops with duplicates in a vector per cell and deduplicating them for each trailhead
+  // got replaced by summit bitsets for part 1 and plain trail counts for part 2.
+  auto uniqueHeadSum = map.countReachableSummits();
+  auto allHeadSum = map.countTrails();
+
   auto t2 = std::chrono::high_resolution_clock::now();
 
   std::cout << "Part1: " << uniqueHeadSum << "\n";
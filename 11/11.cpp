@@ -3,22 +3,19 @@
 #include <list>
 #include <chrono>
 #include <ranges>
-#include <execution>
-#include <atomic>
-#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <span>
+#include <optional>
+#include <mutex>
+#include <shared_mutex>
+#include <cmath>
+#include <stdexcept>
 
+#include <shared/digits.hpp>
 #include <common/task.hpp>
 
-namespace std {
-  template<>
-  struct hash<std::pair<int64_t, int>> {
-    size_t operator()(const std::pair<int64_t, int>& entry) const {
-      return (entry.first + entry.second) * (entry.second+1);
-    }
-  };
-}
-
-
 struct Stones : public std::list<int64_t> {
   Stones(std::istream&& input) {
     for (int64_t stone; input >> stone; ) {
@@ -27,38 +24,266 @@ struct Stones : public std::list<int64_t> {
   }
 };
 
-// Recursively calculates how many stones we will end up with after the given amount of steps.
-// Uses an internal calculation cache to make the function actually computable.
-int64_t stonesAfter(int64_t stone, int steps) {
-  if (steps == 0) {
-    return 1;
+
+/** Minimal open addressing hash map from stone values to numbers (counts or indices) with linear probing.
+ *  Keeps all entries in one flat array instead of allocating a node per entry. New entries start with EMPTY as value.
+ */
+struct StoneMap {
+  static constexpr int64_t EMPTY = -1; // stones are never negative
+
+  StoneMap() : entries(1024, { EMPTY, EMPTY }) {}
+
+  int64_t& operator[](int64_t stone) {
+    if ((size + 1) * 2 > entries.size()) {
+      grow();
+    }
+
+    auto& entry = entries[slot(stone)];
+    if (entry.first == EMPTY) {
+      entry.first = stone;
+      ++size;
+    }
+    return entry.second;
+  }
+
+  std::optional<int64_t> find(int64_t stone) const {
+    auto& entry = entries[slot(stone)];
+    return (entry.first == stone) ? std::optional(entry.second) : std::nullopt;
+  }
+
+  void clear() {
+    std::ranges::fill(entries, std::pair<int64_t, int64_t>(EMPTY, EMPTY));
+    size = 0;
+  }
+
+  std::vector<std::pair<int64_t/*stone*/, int64_t/*value*/>> entries; // capacity is always a power of 2
+  size_t size = 0;
+
+private:
+  // returns the index of the entry for the stone or of the empty entry where it belongs
+  size_t slot(int64_t stone) const {
+    auto mask = entries.size() - 1;
+    for (auto index = ((static_cast<uint64_t>(stone) * 0x9E3779B97F4A7C15ull) >> 32) & mask; ; index = (index + 1) & mask) {
+      if (entries[index].first == stone || entries[index].first == EMPTY) {
+        return index;
+      }
+    }
+  }
+
+  void grow() {
+    auto oldEntries = std::move(entries);
+    entries.assign(oldEntries.size() * 2, { EMPTY, EMPTY });
+    for (auto& entry : oldEntries) {
+      if (entry.first != EMPTY) {
+        entries[slot(entry.first)] = entry;
+      }
+    }
+  }
+};
+
+
+/** Answers how many stones a single stone turns into after a number of blinks for batches of (stone, blinks) queries.
+ *  Each distinct stone value reachable from the queried stones gets an index and its successors after one blink are stored
+ *  in a transition table shared by all queries. A single sweep over the blinks then calculates the stone counts of all values
+ *  for all depths up to the largest queried one, so each query is a simple table lookup afterwards. The sweep only keeps
+ *  two rows of counts and stores the rows for the queried blink counts, so memory doesn't grow with the number of blinks.
+ *  Lookups only take a shared lock. The table is only rebuilt (exclusively) if a query isn't covered by it yet.
+ *  Note: The stone counts exceed 64 bits beyond ~150 blinks.
+ */
+class StoneCounter {
+public:
+  struct Query {
+    int64_t stone;
+    int blinks;
+  };
+
+  std::vector<int64_t> count(std::span<const Query> queries) {
+    if (std::ranges::any_of(queries, [](const Query& query) { return query.stone < 0 || query.blinks < 0; })) {
+      throw std::invalid_argument("stones and blinks must not be negative");
+    }
+
+    {
+      std::shared_lock lock(mutex);
+      if (covers(queries)) {
+        return lookup(queries);
+      }
+    }
+
+    std::unique_lock lock(mutex);
+    if (!covers(queries)) { // another thread may have rebuilt the table in the meantime
+      rebuild(queries);
+    }
+    return lookup(queries);
+  }
+
+  int64_t count(int64_t stone, int blinks) {
+    Query query = { stone, blinks };
+    return count(std::span(&query, 1))[0];
   }
 
-  static std::unordered_map<std::pair<int64_t/*stone*/, int/*steps*/>, int64_t/*numStones*/> lookUpMap;
-  std::pair<int64_t, int> lookupKey(stone, steps);
-  auto pos = lookUpMap.find(lookupKey);
-  if (pos != lookUpMap.end()) {
-    // we already calculated this value -> return it
-    return pos->second;
+private:
+  bool covers(const Query& query) const {
+    auto index = indices.find(query.stone);
+    return index && query.blinks <= validBlinks[*index] && std::ranges::binary_search(depths, query.blinks);
   }
 
-  int64_t result;
-  if (stone == 0) {
-    result = stonesAfter(1, steps - 1);
-  } else {
-    int64_t nDigits = static_cast<int64_t>(std::log10(stone) + 1);
-    if (nDigits % 2 == 0) {
-      // Rule 2
-      auto [left, right] = std::div(stone, std::pow(10, nDigits / 2));
-      result = stonesAfter(left, steps - 1) + stonesAfter(right, steps - 1);
-    } else {
-      result = stonesAfter(stone * 2024, steps - 1);
+  bool covers(std::span<const Query> queries) const {
+    return std::ranges::all_of(queries, [this](const Query& query) { return covers(query); });
+  }
+
+  std::vector<int64_t> lookup(std::span<const Query> queries) const {
+    std::vector<int64_t> results;
+    results.reserve(queries.size());
+    for (auto& query : queries) {
+      auto row = std::ranges::lower_bound(depths, query.blinks) - depths.begin();
+      results.push_back(counts[row * values.size() + *indices.find(query.stone)]);
     }
+    return results;
   }
-  // store the result for future lookups
-  lookUpMap.emplace(std::move(lookupKey), result);
-  return result;
+
+  void rebuild(std::span<const Query> queries) {
+    // The new table must still cover all previous queries. Covered queries are already implied by the seeds and each
+    // stone only needs to be a seed once with its largest number of blinks.
+    for (auto& query : queries) {
+      if (covers(query)) {
+        continue;
+      }
+
+      auto& seedIndex = seedIndices[query.stone];
+      if (seedIndex == StoneMap::EMPTY) {
+        seedIndex = static_cast<int64_t>(seeds.size());
+        seeds.push_back(query);
+      } else {
+        seeds[seedIndex].blinks = std::max(seeds[seedIndex].blinks, query.blinks);
+      }
+
+      if (!std::ranges::binary_search(depths, query.blinks)) {
+        depths.insert(std::ranges::upper_bound(depths, query.blinks), query.blinks);
+      }
+    }
+    int maxBlinks = depths.back();
+
+    indices.clear();
+    values.clear();
+    validBlinks.clear();
+
+    // Collect all values, which can be reached from the seeds, together with the max number of blinks they must be
+    // calculated for. By expanding the values with the most remaining blinks first, each value only needs to be expanded once.
+    std::vector<std::vector<int/*index*/>> toExpand(maxBlinks + 1);
+    auto addValue = [&](int64_t stone, int blinks) {
+      auto& index = indices[stone];
+      if (index == StoneMap::EMPTY) {
+        index = static_cast<int64_t>(values.size());
+        values.push_back(stone);
+        validBlinks.push_back(blinks);
+        toExpand[blinks].push_back(static_cast<int>(index));
+      } else if (validBlinks[index] < blinks) {
+        // not yet expanded (or not expanded deep enough) -> expand it with more blinks
+        validBlinks[index] = blinks;
+        toExpand[blinks].push_back(static_cast<int>(index));
+      }
+      return static_cast<int>(index);
+    };
+
+    for (auto& seed : seeds) {
+      addValue(seed.stone, seed.blinks);
+    }
+
+    successors.assign(values.size(), { -1, -1 });
+    for (int blinks = maxBlinks; blinks > 0; --blinks) {
+      for (size_t i = 0; i < toExpand[blinks].size(); ++i) { // may grow while iterating
+        auto index = toExpand[blinks][i];
+        if (validBlinks[index] != blinks) {
+          continue; // has already been expanded with more blinks
+        }
+
+        std::array<int, 2> next = { -1, -1 };
+        auto stone = values[index];
+        if (stone == 0) {
+          next[0] = addValue(1, blinks - 1);
+        } else if (common::digitCount(stone) % 2 == 0) {
+          // Rule 2
+          auto [left, right] = common::splitDigits(stone);
+          next[0] = addValue(left, blinks - 1);
+          next[1] = addValue(right, blinks - 1);
+        } else {
+          next[0] = addValue(stone * 2024, blinks - 1);
+        }
+        successors.resize(values.size(), { -1, -1 });
+        successors[index] = next;
+      }
+    }
+
+    // Now sweep once over all blinks: After 0 blinks each stone is just itself, after that
+    // each value has as many stones as its successors had one blink earlier.
+    const size_t valueCount = values.size();
+    std::vector<int64_t> previous(valueCount, 1);
+    std::vector<int64_t> current(valueCount);
+    counts.assign(depths.size() * valueCount, 0);
+
+    auto storeRow = [&](int blinks, const std::vector<int64_t>& row) {
+      if (auto depth = std::ranges::lower_bound(depths, blinks); depth != depths.end() && *depth == blinks) {
+        std::ranges::copy(row, counts.begin() + (depth - depths.begin()) * valueCount);
+      }
+    };
+
+    storeRow(0, previous);
+    for (int blinks = 1; blinks <= maxBlinks; ++blinks) {
+      for (size_t index = 0; index < valueCount; ++index) {
+        current[index] = 0;
+        if (validBlinks[index] >= blinks) { // successors are only known (and valid) for these
+          for (auto next : successors[index]) {
+            if (next != -1) {
+              current[index] += previous[next];
+            }
+          }
+        }
+      }
+      storeRow(blinks, current);
+      std::swap(previous, current);
+    }
+  }
+
+
+  std::shared_mutex mutex;
+  std::vector<Query> seeds; // distinct queried stones so far with their max number of blinks
+  StoneMap seedIndices; // stone value -> index into seeds
+  std::vector<int> depths; // all queried blink counts so far (sorted)
+  StoneMap indices; // stone value -> index into the following vectors
+  std::vector<int64_t> values;
+  std::vector<int> validBlinks; // max number of blinks the counts of each value are valid for
+  std::vector<std::array<int, 2>> successors; // value indices after one blink (-1 if unused)
+  std::vector<int64_t> counts; // counts[depth row * values.size() + index], one row per entry of depths
+};
+
+
+#if BENCHMARK
+// Compares the table based digit functions against the floating point log10/pow versions we used before
+void benchmarkDigits() {
+  const int64_t N = 100000000;
+  auto measure = [](const char* name, auto&& func) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    int64_t checksum = 0;
+    for (int64_t stone = 1; stone <= N; ++stone) {
+      checksum += func(stone * 7919); // spread the values across more digit counts
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+    std::cout << name << ": " << (static_cast<double>(ns) / N) << "ns/op (checksum " << checksum << ")\n";
+  };
+
+  measure("log10 digit count", [](int64_t stone) { return static_cast<int64_t>(std::log10(stone) + 1); });
+  measure("table digit count", [](int64_t stone) { return static_cast<int64_t>(common::digitCount(stone)); });
+  measure("pow/div split", [](int64_t stone) {
+    auto [left, right] = std::div(stone, static_cast<int64_t>(std::pow(10, static_cast<int64_t>(std::log10(stone) + 1) / 2)));
+    return left + right;
+  });
+  measure("table split", [](int64_t stone) {
+    auto [left, right] = common::splitDigits(stone);
+    return left + right;
+  });
 }
+#endif
 
 
 int main()
@@ -66,20 +291,29 @@ int main()
   auto t1 = std::chrono::high_resolution_clock::now();
   Stones stones(task::input());
    
-  // Part1:
-  int64_t sum1 = 0;
+  // Part 1 & 2: Query both blink counts for all stones in one batch
+  std::vector<StoneCounter::Query> queries;
   for (auto stone : stones) {
-    sum1 += stonesAfter(stone, 25);
+    queries.push_back({ stone, 25 });
+    queries.push_back({ stone, 75 });
   }
 
-  // Part2:
+  StoneCounter counter;
+  auto counts = counter.count(queries);
+
+  int64_t sum1 = 0;
   int64_t sum2 = 0;
-  for (auto stone : stones) {
-    sum2 += stonesAfter(stone, 75);
+  for (size_t i = 0; i < counts.size(); i += 2) {
+    sum1 += counts[i];
+    sum2 += counts[i + 1];
   }
   
   auto t2 = std::chrono::high_resolution_clock::now();
   std::cout << "Part1: " << sum1 << "\n";
   std::cout << "Part2: " << sum2 << "\n";
   std::cout << "Time " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << "ms\n";  
+
+#if BENCHMARK
+  benchmarkDigits();
+#endif
 }
@@ -1,96 +1,231 @@
 #include <iostream>
 #include <fstream>
-#include <list>
 #include <chrono>
-#include <ranges>
-#include <atomic>
-#include <unordered_map>
-#include <unordered_set>
+#include <vector>
 #include <algorithm>
+#include <thread>
+#include <numeric>
 
 #include <common/field.hpp>
-#include <common/hash.hpp>
 #include <common/task.hpp>
 
-struct Region {
-  Region(char type, const Vector& startPosition, const Field& field) : type(type) {
-    collectPositions(startPosition, field);
+struct RegionStats {
+  int64_t area = 0;
+  int64_t perimeter = 0;
+  int64_t corners = 0; // a region has as many sides as it has corners
+
+  RegionStats& operator+=(const RegionStats& other) {
+    area += other.area;
+    perimeter += other.perimeter;
+    corners += other.corners;
+    return *this;
   }
+};
 
-  char type;
-  std::unordered_set<Vector> positions;
 
-private:
-  void collectPositions(const Vector& startPosition, const Field& field) {
-    positions.insert(startPosition);
-    for (auto direction : Vector::AllSimpleDirections()) {
-      auto neighbor = startPosition + direction;
-      if (field.validPosition(neighbor) && field[neighbor] == type && !positions.contains(neighbor)) {
-        collectPositions(neighbor, field);
+struct Garden : public Field {
+  Garden(std::istream&& input) : Field(input) {}
+
+  /** Labels all regions with union-find. Each cell is joined with its left and upper neighbor if they have the same type.
+   *  Large gardens are split into horizontal bands, which are labeled in parallel. Since the root of a set is always its
+   *  smallest offset, each band only ever touches its own part of regionIds.
+   *
+   *  Stats are only kept per region, not per cell: each band numbers its regions consecutively and accumulates the cell
+   *  contributions into its own table. Afterwards the band labels become global labels (offset by the region counts of
+   *  the previous bands) and the regions are joined across the band boundaries with a second, much smaller union-find
+   *  over the labels, which merges their stats.
+   *  Memory: 1 byte (type) + 8 bytes (label) per cell and 32 bytes (stats + label parent) per band region.
+   */
+  void labelRegions() {
+    regionIds.resize(data.size());
+
+    const int bandCount = std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1, std::max(size.y, 1));
+    std::vector<int> bandRows; // first row of each band + end row
+    for (int band = 0; band <= bandCount; ++band) {
+      bandRows.push_back(static_cast<int>(static_cast<int64_t>(size.y) * band / bandCount));
+    }
+
+    std::vector<std::vector<RegionStats>> bandStats(bandCount);
+    std::vector<std::thread> threads;
+    for (int band = 0; band < bandCount; ++band) {
+      threads.emplace_back([this, firstRow = bandRows[band], endRow = bandRows[band + 1], &regionStats = bandStats[band]]() {
+        labelRows(firstRow, endRow, regionStats);
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    // The regions of each band are numbered after the ones of the previous bands
+    std::vector<int64_t> firstLabels(bandCount, 0);
+    stats.clear();
+    for (int band = 0; band < bandCount; ++band) {
+      firstLabels[band] = static_cast<int64_t>(stats.size());
+      stats.insert(stats.end(), bandStats[band].begin(), bandStats[band].end());
+      bandStats[band] = {}; // release the memory early
+    }
+
+    threads.clear();
+    for (int band = 1; band < bandCount; ++band) {
+      auto begin = static_cast<int64_t>(bandRows[band]) * size.x;
+      auto end = static_cast<int64_t>(bandRows[band + 1]) * size.x;
+      threads.emplace_back([this, begin, end, firstLabel = firstLabels[band]]() {
+        for (auto offset = begin; offset < end; ++offset) {
+          regionIds[offset] += firstLabel;
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    // Join the regions across the band boundaries
+    labelParents.resize(stats.size());
+    std::iota(labelParents.begin(), labelParents.end(), int64_t(0));
+    for (int band = 1; band < bandCount; ++band) {
+      auto row = bandRows[band];
+      for (int column = 0; column < size.x; ++column) {
+        auto offset = static_cast<int64_t>(toOffset(Vector(column, row)));
+        if (data[offset - size.x] == data[offset]) {
+          uniteLabels(regionIds[offset], regionIds[offset - size.x]);
+        }
       }
     }
   }
-};
 
+  /** Labels the given rows as if they were the whole garden. Afterwards each cell of the band contains the label of its
+   *  band region (index into regionStats, which holds the accumulated stats of each band region).
+   */
+  void labelRows(int firstRow, int endRow, std::vector<RegionStats>& regionStats) {
+    auto begin = static_cast<int64_t>(firstRow) * size.x;
+    auto end = static_cast<int64_t>(endRow) * size.x;
 
-int main() {
-  auto t1 = std::chrono::high_resolution_clock::now();
-  Field field(task::input());
-
-  std::vector<Region> regions;
-  
-  // Collect the regions while checking all positions
-  for (size_t offset = 0; offset < field.data.size(); ++offset) {
-    auto position = field.fromOffset(offset);
-    auto type = field[position];
-    
-    if (!std::ranges::any_of(regions, [&](const Region& region) { return region.type == type && region.positions.contains(position); })) {
-      // Region not yet known -> new region
-      regions.emplace_back(type, position, field);
+    for (auto offset = begin; offset < end; ++offset) {
+      regionIds[offset] = offset;
+      auto column = offset % size.x;
+      if (column > 0 && data[offset - 1] == data[offset]) {
+        unite(offset, offset - 1);
+      }
+      if (offset - size.x >= begin && data[offset - size.x] == data[offset]) {
+        unite(offset, offset - size.x);
+      }
+    }
+
+    // Point each cell directly to its root (parents always have smaller offsets, so they are already done)
+    for (auto offset = begin; offset < end; ++offset) {
+      regionIds[offset] = findRoot(offset);
+    }
+
+    // The root is the first cell of each region, so the labels can be assigned in the same order
+    for (auto offset = begin; offset < end; ++offset) {
+      if (regionIds[offset] == offset) {
+        regionIds[offset] = static_cast<int64_t>(regionStats.size());
+        regionStats.emplace_back();
+      } else {
+        regionIds[offset] = regionIds[regionIds[offset]]; // root has already been replaced by its label
+      }
+      regionStats[regionIds[offset]] += cellStats(fromOffset(offset));
     }
   }
 
+  /** Contribution of a single cell to its region's stats. The perimeter is made up of all sides facing another type.
+   *  Instead of following the sides we count the region corners at each of the cell's corners. A corner is either
+   *  convex (both orthogonal neighbors differ) or concave (both orthogonal neighbors match, but the diagonal one doesn't).
+   */
+  RegionStats cellStats(const Vector& position) const {
+    RegionStats result;
+    result.area = 1;
 
-  int cost = 0;
-  int discountCost = 0;
-
-  for (auto& region : regions) {
-    int area = region.positions.size();
-    int perimeter = 0;
-    int sides = 0;
-
-    std::unordered_set<std::pair<Vector/*position*/, Vector/*direction*/>> countedSides; // to not double count
-    
-    for (auto& position : region.positions) {
-      // Count up the sides, which either touch the field border or another type of field
-      // The total number of these sides make up the perimeter
-      for (auto direction : Vector::AllSimpleDirections())  {
-        auto neighbor = position + direction;
-        if (!field.validPosition(neighbor) || field[neighbor] != region.type) {
-          // This side is not touching another internal field 
-          ++perimeter;
-          
-          if (!countedSides.contains({ position, direction })) {
-            // We didn't count this side yet... continue in CW and CCW direction from current position and
-            // mark all positions making up this side to not double count them when checking other positions
-            ++sides;
-            for (auto sideDirection : { direction.rotateCW(), direction.rotateCCW() }) {
-              // Continue in this direction for as long as the positions are part of the field and
-              // as long as the line doesn't enter into the field (not being a perimeter anymore)
-              for (auto nextPos = position + sideDirection; region.positions.contains(nextPos) && !field.isAt(region.type, nextPos + direction); nextPos += sideDirection) {
-                countedSides.emplace(nextPos, direction);
-              }
-            }
-          }
-        }
+    auto type = (*this)[position];
+    for (auto direction : Vector::AllSimpleDirections()) {
+      auto sideDirection = direction.rotateCW();
+      bool sameType = isAt(type, position + direction);
+      bool sideSameType = isAt(type, position + sideDirection);
+
+      if (!sameType) {
+        ++result.perimeter;
+      }
+
+      if ((!sameType && !sideSameType) || (sameType && sideSameType && !isAt(type, position + direction + sideDirection))) {
+        ++result.corners;
       }
     }
 
+    return result;
+  }
+
+  int64_t findRoot(int64_t offset) {
+    while (regionIds[offset] != offset) {
+      regionIds[offset] = regionIds[regionIds[offset]]; // path halving
+      offset = regionIds[offset];
+    }
+    return offset;
+  }
 
-    cost += area * perimeter;
-    discountCost += area * sides;
+  // Joins the sets of both cells within a band, the smaller offset becomes the root
+  void unite(int64_t offset1, int64_t offset2) {
+    auto root1 = findRoot(offset1);
+    auto root2 = findRoot(offset2);
+    if (root1 != root2) {
+      regionIds[std::max(root1, root2)] = std::min(root1, root2);
+    }
   }
 
+  int64_t findLabel(int64_t label) {
+    while (labelParents[label] != label) {
+      labelParents[label] = labelParents[labelParents[label]]; // path halving
+      label = labelParents[label];
+    }
+    return label;
+  }
+
+  // Joins two band regions across a band boundary and merges their stats
+  void uniteLabels(int64_t label1, int64_t label2) {
+    auto root1 = findLabel(label1);
+    auto root2 = findLabel(label2);
+    if (root1 == root2) {
+      return;
+    }
+
+    if (root2 < root1) {
+      std::swap(root1, root2);
+    }
+    labelParents[root2] = root1;
+    stats[root1] += stats[root2];
+  }
+
+  // Iterates over the stats of all regions
+  template<typename Func>
+  void forEachRegion(Func&& func) const {
+    for (int64_t label = 0; label < static_cast<int64_t>(stats.size()); ++label) {
+      if (labelParents[label] == label) {
+        func(stats[label]);
+      }
+    }
+  }
+
+
+  std::vector<int64_t> regionIds; // band region label per cell (the region is findLabel() of it)
+  std::vector<RegionStats> stats; // accumulated stats per band region (complete for label roots)
+  std::vector<int64_t> labelParents; // union-find over the band region labels
+};
+
+
+int main() {
+  auto t1 = std::chrono::high_resolution_clock::now();
+  Garden garden(task::input());
+
+  // Collecting each region recursively into a set and checking all known regions for each cell got replaced by
+  // a single (banded parallel) union-find pass, which also accumulates the area, perimeter and corner count of each region.
+  garden.labelRegions();
+
+  int64_t cost = 0;
+  int64_t discountCost = 0;
+  garden.forEachRegion([&](const RegionStats& region) {
+    cost += region.area * region.perimeter;
+    discountCost += region.area * region.corners;
+  });
+
   auto t2 = std::chrono::high_resolution_clock::now();
 
   std::cout << "Part1: " << cost << "\n";
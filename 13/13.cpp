@@ -1,81 +1,128 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
-#include <regex>
-#include <chrono>
+#include <array>
 #include <string>
+#include <iterator>
+#include <chrono>
+#include <algorithm>
+#include <limits>
 
-#include <common/vector.hpp>
 #include <common/task.hpp>
 
-std::regex buttonRegex("^Button [AB]: X\\+([0-9]+), Y\\+([0-9]+)$");
-std::regex prizeRegex("^Prize: X=([0-9]+), Y=([0-9]+)$");
-
-
-struct Button : public VectorT<int64_t> {
-  int cost;
-};
-
-struct Game {
-  Button A, B; // A costs 3, B costs 1
-  VectorT<int64_t> prize; 
-
-  int64_t countCost(Vector position = Vector::Zero, int currentCost = 0, int currentButtons = 0) const {
-    auto term1 = A.x * prize.y - A.y * prize.x;
-    auto term2 = A.x * B.y - A.y * B.x;
+const int64_t CostA = 3;
+const int64_t CostB = 1;
+const int64_t PrizeOffset = 10000000000000;
+
+/** All claw machines in a structure of arrays layout, so the solver can run over contiguous arrays.
+ *  Parsing simply takes the numbers in order of their appearance (A.x, A.y, B.x, B.y, Prize.x, Prize.y),
+ *  which is quite a bit faster than matching each line with a regex.
+ */
+struct ClawMachines {
+  ClawMachines(std::istream&& input) {
+    std::string text(std::istreambuf_iterator<char>(input), {});
+
+    std::array<int64_t, 6> numbers;
+    size_t count = 0;
+    for (size_t pos = 0; pos < text.size(); ) {
+      if (text[pos] < '0' || text[pos] > '9') {
+        ++pos;
+        continue;
+      }
+
+      int64_t number = 0;
+      for (; pos < text.size() && text[pos] >= '0' && text[pos] <= '9'; ++pos) {
+        number = number * 10 + (text[pos] - '0');
+      }
+
+      numbers[count++] = number;
+      if (count == numbers.size()) {
+        ax.push_back(numbers[0]);
+        ay.push_back(numbers[1]);
+        bx.push_back(numbers[2]);
+        by.push_back(numbers[3]);
+        px.push_back(numbers[4]);
+        py.push_back(numbers[5]);
+        count = 0;
+      }
+    }
+  }
 
-    // by performing the integer division last we ensure that there is no hidden truncation mid way in the calculation
-    auto b = term1 / term2;
-    auto a = (prize.x - b * B.x) / A.x;
+  /** Solves all machines with Cramer's rule and returns the total costs without (first) and with the prize offset (second).
+   *  The determinant and the offset free parts of the numerators are shared by both parts. The offset only adds
+   *  offset * (B.y - B.x) and offset * (A.x - A.y) to the numerators, so no product ever involves the offset prize
+   *  coordinates directly. A machine can only be won if both numerators are divisible by the determinant.
+   *  Machines which could overflow 64 bit integers (see fitsInt64()) are skipped and reported.
+   */
+  std::pair<int64_t, int64_t> countCosts(int64_t offset) const {
+    int64_t costs = 0;
+    int64_t offsetCosts = 0;
+
+    for (size_t i = 0; i < ax.size(); ++i) {
+      if (!fitsInt64(i, 0)) {
+        std::cerr << "Skipping machine " << i << ": its numbers are too large for 64 bit integers\n";
+        continue;
+      }
+
+      auto det = ax[i] * by[i] - ay[i] * bx[i];
+      if (det == 0) {
+        continue; // buttons move in the same direction (doesn't happen in the puzzle input)
+      }
+
+      auto numeratorA = px[i] * by[i] - py[i] * bx[i];
+      auto numeratorB = ax[i] * py[i] - ay[i] * px[i];
+      costs += cost(numeratorA, numeratorB, det);
+
+      if (!fitsInt64(i, offset)) {
+        std::cerr << "Skipping machine " << i << " with offset: its numbers are too large for 64 bit integers\n";
+        continue;
+      }
+      offsetCosts += cost(numeratorA + offset * (by[i] - bx[i]), numeratorB + offset * (ax[i] - ay[i]), det);
+    }
 
-    return (a >= 0 && b >= 0 && a * A + b * B == prize) ? (a * A.cost + b * B.cost) : 0;
+    return { costs, offsetCosts };
   }
-};
 
-struct Games : public std::vector<Game> {
-  Games(std::istream&& stream) {
-    std::string line;
-    while (std::getline(stream, line)) {
-      Game game;
-      std::smatch results;
-      std::regex_match(line, results, buttonRegex);
-      game.A.x = std::stoi(results.str(1));
-      game.A.y = std::stoi(results.str(2));
-      game.A.cost = 3;
-      
-      std::getline(stream, line);
-      std::regex_match(line, results, buttonRegex);
-      game.B.x = std::stoi(results.str(1));
-      game.B.y = std::stoi(results.str(2));
-      game.B.cost = 1;
-
-      std::getline(stream, line);
-      std::regex_match(line, results, prizeRegex);
-      game.prize.x = std::stoi(results.str(1));
-      game.prize.y = std::stoi(results.str(2));
-      push_back(game);
-
-      std::getline(stream, line); // read empty follow line
+  /** All numbers are non-negative, so every product above is the product of a prize coordinate (+ offset) or a button
+   *  coordinate with a button coordinate, and every difference of two such products has at most the same magnitude
+   *  (this includes the offset numerators, which equal (P.x + offset) * B.y - (P.y + offset) * B.x). Valid press counts
+   *  are bounded by max prize coordinate + offset, so a single machine costs at most that times (CostA + CostB).
+   *  Thus a machine can be solved in 64 bits if
+   *    max(P.x + offset, P.y + offset, A.x, A.y, B.x, B.y) * max(A.x, A.y, B.x, B.y, CostA + CostB) <= INT64_MAX
+   *  For the puzzle input (coordinates < 10^5, offset 10^13) this is about 10^18, well below INT64_MAX (~9.2 * 10^18).
+   */
+  bool fitsInt64(size_t i, int64_t offset) const {
+    const auto limit = std::numeric_limits<int64_t>::max();
+    auto button = std::max({ ax[i], ay[i], bx[i], by[i] });
+    auto prize = std::max(px[i], py[i]);
+    if (prize > limit - offset) {
+      return false;
     }
+    return std::max(prize + offset, button) <= limit / std::max(button, CostA + CostB);
+  }
+
+  static int64_t cost(int64_t numeratorA, int64_t numeratorB, int64_t det) {
+    auto a = numeratorA / det;
+    auto b = numeratorB / det;
+    bool valid = (numeratorA % det == 0) && (numeratorB % det == 0) && a >= 0 && b >= 0;
+    return valid ? (a * CostA + b * CostB) : 0;
   }
+
+
+  std::vector<int64_t> ax, ay; // button A
+  std::vector<int64_t> bx, by; // button B
+  std::vector<int64_t> px, py; // prize
 };
 
 
 int main()
 {
   auto t1 = std::chrono::high_resolution_clock::now();
-  Games games(task::input());
+  ClawMachines machines(task::input());
 
-  int64_t totalCoins = 0;
-  int64_t correctedCoins = 0;
   // Part 1 & 2: 
-  for (auto& game : games) {
-    // Simply calculate the number of button presses... brute force seems to be actually more complicated than calculation
-    totalCoins += game.countCost();
-    // Correct the prize position for part 2
-    game.prize += VectorT<int64_t>(10000000000000, 10000000000000);
-    correctedCoins += game.countCost();
-  }
+  // Simply calculate the number of button presses... brute force seems to be actually more complicated than calculation
+  auto [totalCoins, correctedCoins] = machines.countCosts(PrizeOffset);
 
   
   auto t2 = std::chrono::high_resolution_clock::now();
@@ -3,6 +3,9 @@
 #include <chrono>
 #include <ranges>
 #include <map>
+#include <array>
+#include <vector>
+#include <algorithm>
 
 #include <common/field.hpp>
 #include <common/hash.hpp>
@@ -18,51 +21,187 @@ struct Warehouse : public Field {
     }
 
     // lookup robot position only once and update it afterwards
-    robotPos = fromOffset(findOffset('@'));
+    robotOffset = findOffset('@');
   }
 
 
   void runInstructions() {
     for (auto instruction : instructions) {
-      auto direction = instructionTranslation[instruction];
-      if (tryMove(robotPos, direction)) {
-        // move successful -> update robotPos
-        robotPos += direction;
-      }
+      tryMove(offsetStep(instruction));
+    }
+  }
+
+  /** Same result as runInstructions(), but runs of identical instructions are executed at once
+   */
+  void runInstructionsBatched() {
+    for (size_t begin = 0; begin < instructions.size(); ) {
+      auto end = std::min(instructions.find_first_not_of(instructions[begin], begin), instructions.size());
+      runMoves(offsetStep(instructions[begin]), end - begin);
+      begin = end;
+    }
+  }
+
+  /** Moves the robot count times by the given offset step (as far as possible).
+   *  Wide boxes pushed vertically can spread out to more boxes with every move, so these are still moved one by one,
+   *  but once a move fails, all following moves fail as well. Everything else is a push along a line.
+   */
+  void runMoves(ptrdiff_t step, size_t count) {
+    if (step == 0) {
+      return; // not a move instruction (e.g. '\r')
+    }
+
+    bool vertical = step != 1 && step != -1;
+    if (vertical && wideBoxes) {
+      for (size_t i = 0; i < count && tryMove(step); ++i);
+    } else {
+      pushLineRun(step, count);
     }
   }
 
-  /** Attempt to move a robot or box from position in given direction.
-   *  Operation will fail if attempting to move into a wall. If this operation fails,
+  // Translates an instruction into an offset step (the warehouse is surrounded by walls, so we never leave the field)
+  ptrdiff_t offsetStep(char instruction) const {
+    switch (instruction) {
+      case '^': return -size.x;
+      case 'v': return size.x;
+      case '<': return -1;
+      case '>': return 1;
+      default: return 0;
+    }
+  }
+
+  static bool isBox(char c) {
+    return c == 'O' || c == '[' || c == ']';
+  }
+
+  /** Attempt to move the robot by the given offset step, pushing all boxes in the way.
+   *  Operation will fail if any of the pushed boxes would have to move into a wall. If this operation fails,
    *  no move will have been performed. If it succeeds, all required moves will have been performed.
    */
-  virtual bool tryMove(Vector fromPos, Vector direction, bool checkOnly = false) {
-    Vector toPos = fromPos + direction;
+  bool tryMove(ptrdiff_t step) {
+    if (step == 0) {
+      return false; // not a move instruction (e.g. '\r')
+    }
+
+    bool vertical = step != 1 && step != -1;
+    auto toOffset = robotOffset + step;
+    bool wideBox = data[toOffset] == '[' || data[toOffset] == ']';
+
+    bool moved = (vertical && wideBox) ? pushWideVertical(step) : pushLine(step);
+    if (moved) {
+      robotOffset += step;
+    }
+    return moved;
+  }
 
-    auto& atDestination = (*this)[toPos];
-    if (atDestination == '#') {
+  /** Push a line of boxes (any push of normal boxes or a horizontal push of wide boxes).
+   *  All boxes in front of the robot form a contiguous line, so we only need to find its end. If there is a free cell
+   *  behind it, the whole line including the robot shifts by one cell.
+   */
+  bool pushLine(ptrdiff_t step) {
+    auto end = robotOffset + step;
+    while (isBox(data[end])) {
+      end += step;
+    }
+    if (data[end] == '#') {
       return false; // cannot move into wall
-    } else if (atDestination == 'O' && !tryMove(toPos, direction)) {
-      return false; // failed to move box, which had to be moved
     }
 
-    // Otherwise move is possible...
-    if (!checkOnly) {
-      std::swap(atDestination, (*this)[fromPos]);
+    for (auto offset = end; offset != robotOffset; offset -= step) {
+      data[offset] = data[offset - step];
+    }
+    data[robotOffset] = '.';
+    return true;
+  }
+
+  /** Push a line of boxes count times.
+   *  Every move consumes the next free cell in front of the robot until it hits a wall, so after count moves the robot
+   *  and all boxes between it and the count-th free cell are packed against that cell in the same order, with the free
+   *  cells left behind the robot.
+   */
+  void pushLineRun(ptrdiff_t step, size_t count) {
+    size_t freeCells = 0;
+    auto lastFree = robotOffset;
+    for (auto offset = robotOffset + step; freeCells < count && data[offset] != '#'; offset += step) {
+      if (data[offset] == '.') {
+        ++freeCells;
+        lastFree = offset;
+      }
+    }
+    if (freeCells == 0) {
+      return; // blocked by a wall
+    }
+
+    if (step == 1) {
+      // contiguous row segment -> std::remove packs the robot and box runs with memmove speed (backwards, towards lastFree)
+      auto first = std::make_reverse_iterator(data.begin() + lastFree + 1);
+      auto last = std::make_reverse_iterator(data.begin() + robotOffset);
+      std::fill(std::remove(first, last, '.'), last, '.');
+    } else if (step == -1) {
+      auto first = data.begin() + lastFree;
+      auto last = data.begin() + robotOffset + 1;
+      std::fill(std::remove(first, last, '.'), last, '.');
+    } else {
+      // vertical segment -> same packing with a stride of one row
+      auto write = lastFree;
+      for (auto read = lastFree; read != robotOffset - step; read -= step) {
+        if (data[read] != '.') {
+          data[write] = data[read];
+          write -= step;
+        }
+      }
+      for (; write != robotOffset - step; write -= step) {
+        data[write] = '.';
+      }
+    }
+
+    robotOffset += freeCells * step;
+  }
+
+  /** Push wide boxes vertically. Every box can push up to two boxes, so the affected boxes form a tree (or rather a
+   *  pyramid, as boxes can be pushed by two boxes at once). First collect all of them row by row with a BFS, then move
+   *  them starting with the farthest row, so every box moves into already emptied cells.
+   */
+  bool pushWideVertical(ptrdiff_t step) {
+    pushedBoxes.clear(); // offsets of the left box halves in BFS order
+
+    auto addBox = [this](size_t offset) {
+      auto left = data[offset] == ']' ? offset - 1 : offset;
+      // Each row is collected from left to right (the boxes of the previous row are in that order and each one adds its
+      // targets from left to right). A box can only be reached by the two neighbouring boxes above it, so a duplicate is
+      // always the box added last.
+      if (pushedBoxes.empty() || pushedBoxes.back() != left) {
+        pushedBoxes.push_back(left);
+      }
+    };
+
+    addBox(robotOffset + step);
+    for (size_t i = 0; i < pushedBoxes.size(); ++i) {
+      auto box = pushedBoxes[i];
+      for (auto target : { box + step, box + step + 1 }) {
+        if (data[target] == '#') {
+          return false; // cannot move into wall -> nothing has been moved so far
+        } else if (data[target] == '[' || data[target] == ']') {
+          addBox(target);
+        }
+      }
+    }
+
+    for (auto box : pushedBoxes | std::views::reverse) {
+      data[box] = '.';
+      data[box + 1] = '.';
+      data[box + step] = '[';
+      data[box + step + 1] = ']';
     }
+    data[robotOffset + step] = '@';
+    data[robotOffset] = '.';
     return true;
   }
 
 
   std::string instructions;
-  Vector robotPos;
-
-  std::map<char, Vector> instructionTranslation = {
-    {'^', Vector::Up},
-    {'<', Vector::Left},
-    {'v', Vector::Down},
-    {'>', Vector::Right}
-  };
+  size_t robotOffset = 0;
+  bool wideBoxes = false;
+  std::vector<size_t> pushedBoxes; // reused between pushes
 };
 
 
@@ -75,6 +214,7 @@ std::map<char, std::array<char, 2>> wideningMap = {
 
 
 
+// Same rules as the normal warehouse, only the field is twice as wide
 struct WarehouseWide : public Warehouse {
   WarehouseWide(const Warehouse& other) : Warehouse(other.size.x*2, other.size.y) {
     data.clear();
@@ -86,63 +226,10 @@ struct WarehouseWide : public Warehouse {
     }
 
     instructions = other.instructions;
+    wideBoxes = true;
 
     // lookup robot position only once and update it afterwards
-    robotPos = fromOffset(findOffset('@'));
-  }
-
-  virtual bool tryMove(Vector fromPos, Vector direction, bool checkOnly = false) override {
-    Vector toPos = fromPos + direction;
-
-    auto& atDestination = (*this)[toPos];
-    if (atDestination == '#') {
-      return false; // cannot move into wall
-    } 
-
-    // we need to treat horizontal and vertical movement differently...
-    // because boxes are wider than they are tall
-    bool horizontal = (direction.x != 0);
-
-    if (horizontal) {
-      // In horizontal direction we only need to try to move both box parts separately
-      if ((atDestination == '[' || atDestination == ']') && !tryMove(toPos, direction, checkOnly)) {
-        // Moving the box failed -> cannot perform move
-        return false;
-      }
-    } else {
-      // Vertical movement must differentiate, because we must move both box parts at the same time.
-      // Here we must always call tryMove with the checkOnly flag as we do NOT want to perform any moves on the right branch 
-      // if the left branch prevents the move
-      if (atDestination == '[') {
-        if (tryMove(toPos, direction, true) && tryMove(toPos + Vector::Right, direction, true)) { 
-          // Move of both branches is possible -> perform the actual move (unless we are in a checkonly branch)
-          if (!checkOnly) {
-            tryMove(toPos, direction);
-            tryMove(toPos + Vector::Right, direction);
-          }
-        } else {
-          // Movement of at least one branch is not possible so the entire move is not possible
-          return false;
-        }
-      } else if (atDestination == ']') {
-        if (tryMove(toPos, direction, true) && tryMove(toPos + Vector::Left, direction, true)) {
-          // Move of both branches is possible -> perform the actual move (unless we are in a checkonly branch)
-          if (!checkOnly) {
-            tryMove(toPos, direction);
-            tryMove(toPos + Vector::Left, direction);
-          }
-        } else {
-          // Movement of at least one branch is not possible so the entire move is not possible
-          return false;
-        }
-      }
-    }
-
-    // Move is possible...
-    if (!checkOnly) {
-      std::swap(atDestination, (*this)[fromPos]);
-    }
-    return true;
+    robotOffset = findOffset('@');
   }
 };
 
@@ -154,7 +241,7 @@ int main() {
   WarehouseWide wideHouse(warehouse);
 
   // Part 1:
-  warehouse.runInstructions();
+  warehouse.runInstructionsBatched();
   
   // Now collect all pox positions
   int boxPosSum = 0;
@@ -165,7 +252,7 @@ int main() {
 
 
   // Part 2:
-  wideHouse.runInstructions();
+  wideHouse.runInstructionsBatched();
 
   // Now collect all pox positions
   int boxPosSum2 = 0;
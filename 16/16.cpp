@@ -2,150 +2,225 @@
 #include <fstream>
 #include <chrono>
 #include <ranges>
-#include <set>
+#include <queue>
 #include <vector>
-#include <unordered_map>
-#include <unordered_set>
+#include <array>
+#include <functional>
+#include <algorithm>
+#include <limits>
 
 #include <common/field.hpp>
-#include <common/hash.hpp>
 #include <common/task.hpp>
 
 const int RotationCost = 1000;
 const int StepCost = 1;
 
-struct ExpandEntry {
-  ExpandEntry() = default;
-  ExpandEntry(int cost, Vector position, Vector orientation) : cost(cost), position(position), orientation(orientation) {}
-
-  // Entries are ordered based on their cost to expand the low cost entries first
-  // We must include the position and orientation into the ordering as well because we use an std::set<> and 
-  // we would otherwise not include expand entries for differnt positions if they have the same costs
-  std::strong_ordering operator<=>(const ExpandEntry& other) const {
-    auto result = cost <=> other.cost;
-    if (result == std::strong_ordering::equal) {
-      result = position <=> other.position;
-    }
-    if (result == std::strong_ordering::equal) {
-      result = orientation <=> other.orientation;
-    }
-    return result;
-  }
-
-  int cost; // to reach this position
-  Vector position; // of the node to expand
-  Vector orientation; // with the given orientation
-};
-
-
+const int Unreached = std::numeric_limits<int>::max();
 
+/** Dijkstra on a corridor compressed graph.
+ *  Most open cells are corridor cells with exactly two open neighbours, where the only sensible move is to follow the
+ *  corridor. All other open cells (junctions, dead ends, start and end) are nodes. From every node state (node,
+ *  direction) a corridor leads to exactly one other node state, with the forced turns along the way included in its
+ *  costs. Rotations are only considered at nodes (turning within a corridor never pays off).
+ *  A state is encoded as node * 4 + direction with the directions ordered clockwise (RIGHT, DOWN, LEFT, UP), so
+ *  costs and predecessors are plain arrays indexed by state.
+ */
 struct Maze : public Field {
   Maze(std::istream&& input) : Field(input) {
-    startPos = fromOffset(findOffset('S'));
-    endPos = fromOffset(findOffset('E'));
+    startOffset = findOffset('S');
+    endOffset = findOffset('E');
+
+    directionSteps = { 1, size.x, -1, -size.x };
+    buildGraph();
+
+    costs.assign(nodeOffsets.size() * 4, Unreached);
+    predecessors.assign(nodeOffsets.size() * 4, 0);
   }
 
-  // Part 1
-  int solve() { // <- return the min cost reaching end
-    std::set<ExpandEntry> expandList = { {0, startPos, Vector::Right }};
+  // How the optimal paths reached a state (one bit per option, multiple paths can have the same costs)
+  enum : uint8_t {
+    ReachedByCorridor = 1,
+    ReachedByRotationCW = 2,
+    ReachedByRotationCCW = 4,
+  };
 
-    while (!expandList.empty()) {
-      auto entry = *expandList.begin();
-      expandList.erase(expandList.begin());
-      
-      if (!updateCosts(entry)) {
-        // DO not expand this node, because we already know a cheaper (or equally expensive) path to this node
-        // which thus has already been expanded
+  struct Corridor {
+    int target = -1; // node state at the end of the corridor, -1 if there is a wall in that direction
+    int cost = 0;
+  };
+
+  bool isOpen(size_t offset) const {
+    return data[offset] != '#';
+  }
+
+  // Preprocessing: find all nodes and follow the corridors from each of them
+  void buildGraph() {
+    nodeIndex.assign(data.size(), -1);
+    for (size_t offset = 0; offset < data.size(); ++offset) {
+      if (!isOpen(offset)) {
         continue;
       }
 
-      if (entry.position == endPos) {
-        // We are expanding the end tile -> we are done
-        return entry.cost;
+      int openNeighbours = 0;
+      for (auto step : directionSteps) {
+        // the maze is surrounded by walls, so only border cells can have neighbours outside of the field
+        auto neighbour = offset + step;
+        openNeighbours += neighbour < data.size() && isOpen(neighbour);
+      }
+      if (openNeighbours != 2 || offset == startOffset || offset == endOffset) {
+        nodeIndex[offset] = static_cast<int>(nodeOffsets.size());
+        nodeOffsets.push_back(offset);
       }
+    }
 
-      // We have 3 paths to expand (step forward, CW rotation, CCW rotation)
-      auto stepPosition = entry.position + entry.orientation;
-      if ((*this)[stepPosition] != '#') {
-        // No wall -> we can expand in that direction
-        expandList.insert({ entry.cost + StepCost, stepPosition, entry.orientation });
+    corridors.assign(nodeOffsets.size() * 4, {});
+    corridorSources.assign(nodeOffsets.size() * 4, -1);
+    for (size_t node = 0; node < nodeOffsets.size(); ++node) {
+      for (int direction = 0; direction < 4; ++direction) {
+        auto state = static_cast<int>(node * 4 + direction);
+        corridors[state] = followCorridor(nodeOffsets[node], direction);
+        if (corridors[state].target >= 0) {
+          // arriving at a node state requires coming from the cell behind it, so each state has at most one source
+          corridorSources[corridors[state].target] = state;
+        }
       }
+    }
+  }
 
-      // Always add both rotations (they will be conisdered later for expansion)
-      // This will actually blow up the expand list quite a bit
-      expandList.insert({ entry.cost + RotationCost, entry.position, entry.orientation.rotateCW() });
-      expandList.insert({ entry.cost + RotationCost, entry.position, entry.orientation.rotateCCW() });
+  /** Walks the corridor starting at the node in the given direction until the next node is reached.
+   *  If visit is given, it is called for every cell along the way (including the end node).
+   */
+  Corridor followCorridor(size_t offset, int direction, auto visit) const {
+    offset += directionSteps[direction];
+    if (offset >= data.size() || !isOpen(offset)) {
+      return {};
     }
 
-    return -1;
+    int cost = StepCost;
+    while (nodeIndex[offset] < 0) {
+      visit(offset);
+      // corridor cell -> continue straight if possible, otherwise take the only turn
+      if (!isOpen(offset + directionSteps[direction])) {
+        direction = isOpen(offset + directionSteps[(direction + 1) % 4]) ? (direction + 1) % 4 : (direction + 3) % 4;
+        cost += RotationCost;
+      }
+      offset += directionSteps[direction];
+      cost += StepCost;
+    }
+    visit(offset);
+
+    return { nodeIndex[offset] * 4 + direction, cost };
   }
 
-  // Part 2
-  std::unordered_set<Vector> findBestPathPositions(int bestPathCost) const {
-    std::unordered_set<Vector> positions;
-    std::set<ExpandEntry> toCheck;
+  Corridor followCorridor(size_t offset, int direction) const {
+    return followCorridor(offset, direction, [](size_t) {});
+  }
 
-    for (auto& [entry, cost] : costMap) {
-      if (entry.first == endPos && cost == bestPathCost) {
-        // start backtracking from here
-        toCheck.insert({ cost, entry.first, entry.second });
+  // Part 1
+  int solve() { // <- return the min cost reaching end
+    using ExpandEntry = std::pair<int/*cost*/, int/*state*/>;
+    std::priority_queue<ExpandEntry, std::vector<ExpandEntry>, std::greater<>> expandList;
+
+    auto update = [&](int state, int cost, uint8_t reachedBy) {
+      if (cost < costs[state]) {
+        costs[state] = cost;
+        predecessors[state] = reachedBy;
+        expandList.push({ cost, state });
+      } else if (cost == costs[state]) {
+        predecessors[state] |= reachedBy; // another optimal path
       }
-    }
+    };
 
-    while (!toCheck.empty()) {
-      auto entry = *toCheck.begin();
-      toCheck.erase(toCheck.begin());
-      positions.insert(entry.position); // note down part of the path
+    update(nodeIndex[startOffset] * 4 + 0, 0, 0); // start facing RIGHT
+    int bestCost = -1;
 
-      // Now we have 3 options to backtrack the path and we will chose each, which will reduce the cost
-      // 1. step in reverse direction
-      auto stepFromPos = entry.position - entry.orientation;
-      if (getCost(stepFromPos, entry.orientation) == entry.cost - StepCost) {
-        toCheck.insert({ entry.cost - StepCost, stepFromPos, entry.orientation });
+    while (!expandList.empty()) {
+      auto [cost, state] = expandList.top();
+      expandList.pop();
+
+      if (cost > costs[state]) {
+        continue; // outdated entry, the state has already been expanded with lower costs
+      }
+      if (bestCost >= 0 && cost > bestCost) {
+        // Everything that could be part of an optimal path has been expanded. We kept going after reaching the end,
+        // so all states with costs <= bestCost know all of their optimal predecessors
+        break;
       }
+      expandOrder.push_back(state);
 
-      // 2. rotate CW
-      if (getCost(entry.position, entry.orientation.rotateCW()) == entry.cost - RotationCost) {
-        toCheck.insert({ entry.cost - RotationCost, entry.position, entry.orientation.rotateCW() });
+      auto node = state / 4;
+      auto direction = state % 4;
+      if (nodeOffsets[node] == endOffset && bestCost < 0) {
+        bestCost = cost;
       }
 
-      // 3. rotate CCW
-      if (getCost(entry.position, entry.orientation.rotateCCW()) == entry.cost - RotationCost) {
-        toCheck.insert({ entry.cost - RotationCost, entry.position, entry.orientation.rotateCCW() });
+      // We have 3 paths to expand (follow the corridor, CW rotation, CCW rotation)
+      auto& corridor = corridors[state];
+      if (corridor.target >= 0) {
+        update(corridor.target, cost + corridor.cost, ReachedByCorridor);
       }
+      update(node * 4 + (direction + 1) % 4, cost + RotationCost, ReachedByRotationCW);
+      update(node * 4 + (direction + 3) % 4, cost + RotationCost, ReachedByRotationCCW);
     }
 
-    return positions;
+    return bestCost;
   }
 
+  /** Part 2: Count the tiles of all optimal paths.
+   *  Predecessors always have lower costs and were therefore expanded earlier, so a single sweep over the expand
+   *  order in reverse can follow all optimal paths from the end back to the start. Every corridor on one of these
+   *  paths is walked once more to collect its tiles.
+   */
+  size_t countBestPathTiles(int bestPathCost) const {
+    std::vector<bool> onBestPath(costs.size(), false);
+    std::vector<bool> tiles(data.size(), false);
+
+    auto endNode = nodeIndex[endOffset];
+    for (int direction = 0; direction < 4; ++direction) {
+      if (costs[endNode * 4 + direction] == bestPathCost) {
+        onBestPath[endNode * 4 + direction] = true; // start backtracking from here
+      }
+    }
 
-  int getCost(Vector position, Vector orientation) const {
-    auto pos = costMap.find({ position, orientation });
-    return (pos != costMap.end()) ? pos->second : std::numeric_limits<int>::max();
-  }
+    for (auto state : expandOrder | std::views::reverse) {
+      if (!onBestPath[state]) {
+        continue;
+      }
 
-  /** Add new/lower costs to each position/orientation or return false if the cost map already
-   *  contains lower costs
-   */
-  bool updateCosts(ExpandEntry& fromEntry) {
-    auto pos = costMap.find({ fromEntry.position, fromEntry.orientation });
-    if (pos != costMap.end()) {
-      if (pos->second <= fromEntry.cost) {
-        return false; // no update to more expensive path
-      } else {
-        pos->second = fromEntry.cost;
+      auto node = state / 4;
+      auto direction = state % 4;
+      tiles[nodeOffsets[node]] = true; // note down part of the path
+
+      if (predecessors[state] & ReachedByCorridor) {
+        auto source = corridorSources[state];
+        onBestPath[source] = true;
+        followCorridor(nodeOffsets[source / 4], source % 4, [&tiles](size_t offset) { tiles[offset] = true; });
+      }
+      if (predecessors[state] & ReachedByRotationCW) {
+        onBestPath[node * 4 + (direction + 3) % 4] = true;
+      }
+      if (predecessors[state] & ReachedByRotationCCW) {
+        onBestPath[node * 4 + (direction + 1) % 4] = true;
       }
-    } else {
-      // new path with yet unknown cost
-      costMap.insert({{ fromEntry.position, fromEntry.orientation }, fromEntry.cost});
     }
-    return true;
+
+    return std::ranges::count(tiles, true);
   }
 
   
-  Vector startPos;
-  Vector endPos;
-  std::unordered_map<std::pair<Vector/*pos*/, Vector/*orientation*/>, int> costMap; // All entries not in the cost map have implicitly an infinite cost
+  size_t startOffset;
+  size_t endOffset;
+  std::array<ptrdiff_t, 4> directionSteps; // offset change for a step in each direction
+
+  // Compressed graph
+  std::vector<int> nodeIndex; // per cell, -1 for walls and corridor cells
+  std::vector<size_t> nodeOffsets; // per node
+  std::vector<Corridor> corridors; // per node state, leaving the node in that direction
+  std::vector<int> corridorSources; // per node state, the node state whose corridor leads here (or -1)
+
+  std::vector<int> costs; // per node state, Unreached if never reached
+  std::vector<uint8_t> predecessors; // per node state, how the optimal paths reached it
+  std::vector<int> expandOrder; // node states in the order they have been expanded (increasing costs)
 };
 
 
@@ -156,17 +231,11 @@ int main() {
   Maze maze(task::input());
 
   auto minCost = maze.solve();
-  auto positions = maze.findBestPathPositions(minCost);
-  
-  // to print the path
-  // for (auto position : positions) {
-  //   maze[position] = 'O';
-  // }
-
+  auto tiles = maze.countBestPathTiles(minCost);
 
   auto t2 = std::chrono::high_resolution_clock::now();
   std::cout << "Part 1: " << minCost << "\n";
-  std::cout << "Part 2: " << positions.size() << "\n";
+  std::cout << "Part 2: " << tiles << "\n";
 
   std::cout << "Time " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << "ms\n";
 }
@@ -3,10 +3,22 @@
 #include <fstream>
 #include <chrono>
 #include <ranges>
+#include <algorithm>
+#include <limits>
+#include <array>
+#include <utility>
+#include <thread>
+#include <atomic>
+#include <bit>
 
 #include <common/task.hpp>
 
 struct ProgramState {
+  struct Register {
+    int64_t A = 0, B = 0, C = 0;
+    int IP = 0;
+  };
+
   ProgramState(std::istream&& input) {
     std::string dummy;
     input >> dummy >> dummy >> reg.A;
@@ -24,91 +36,73 @@ struct ProgramState {
   }
 
 
-  // Part 2 optimized - will be compiled directly into assembler code
-  void fastRun(int A) {
-    int B = 0, C = 0;
-    output.clear();
+  /** Part 2 only works for programs with the structure all puzzle inputs share: a single loop ending with the only
+   *  "jnz 0", which shifts A right by 3 (adv 3) and outputs exactly one value per iteration. B and C are derived from A
+   *  again in each iteration, so the n-th output only depends on A >> (3*n). The last output therefore only depends on the
+   *  highest 3 bits of A, the second to last one on the highest 6 bits and so on.
+   */
+  bool hasShiftLoopStructure() const {
+    if (code.size() < 4 || code.size() % 2 != 0) {
+      return false;
+    }
 
-    // disassembled code
-    do {
-      B = A % 8;			    // 2 4
-      B = B ^ 1;			    // 1 1
-      C = A / (1 << B);		// 7 5
-      B = B ^ 5;			    // 1 5
-      A = A / (1 << 3);		// 0 3
-      B = B ^ C;			    // 4 3
-      output.push_back(B % 8);	// 5 5
-    } while (A && output.size() <= code.size()); // 0 0
+    int jumps = 0, shifts = 0, outputs = 0;
+    for (size_t ip = 0; ip + 1 < code.size(); ip += 2) {
+      if (code[ip] == 0 && code[ip + 1] != 3) {
+        return false; // A changes differently
+      }
+      shifts += (code[ip] == 0);
+      jumps += (code[ip] == 3);
+      outputs += (code[ip] == 5);
+    }
+    return jumps == 1 && shifts == 1 && outputs == 1 && code[code.size() - 2] == 3 && code.back() == 0;
   }
 
+  /** Part 2: Assembles A in 3-bit groups, starting with the highest group producing the last output.
+   *  Each candidate is checked by running the actual program, so nothing about the specific program has to be known.
+   *  Candidates are tried in ascending order, so the first complete match is the lowest A.
+   *  Returns -1 if the program doesn't have the required structure or is no quine for any A.
+   */
+  int64_t reverseSearch() const {
+    if (!hasShiftLoopStructure()) {
+      return -1;
+    }
 
-  // Part 2 with my own optimizations
-  bool fastRunOpti(int64_t A) {
-    int64_t B = 0, C = 0;
-
-    auto codePos = code.begin();
-    auto codeEnd = code.end();
-
-    // disassembled code
-    do {
-      B = A & 0x7;  	    // 2 4
-      B = B ^ 0x1;	      // 1 1 = (A & 0x7) ^ 0x1
-      C = A >> B;	       	// 7 5 = A >> ((A & 0x7) ^ 0x1)
-      B = B ^ 0x5;		    // 1 5 = (A & 0x7) ^ 0x4
-      A = A >> 3;	       	// 0 3 
-      B = B ^ C;			    // 4 3 = ((A & 0x7) ^ 0x4) ^ (A >> ((A & 0x7) ^ 0x1))
-      if (*(codePos++) != (B & 0x7)) {
-        return false; // output/code mismatch
-      }
-    } while (A && codePos != codeEnd); // 0 0
-
-    return A == 0; // otherwise the output is longer
+    ProgramState vm = *this; // reused for all candidates
+    return reverseSearchHelp(vm, 1, 0);
   }
 
-
-  // Part 2 actually working solution of simply searching the required bits 
-  //        by knowing what the output should be and assembling the number in 3-bit blocks
-  int64_t reverseSearchHelp(int* pos, int* end, int64_t currentA) {
-    if (pos == end) {
-      return currentA;
+  int64_t reverseSearchHelp(ProgramState& vm, size_t outputCount, int64_t prefix) const {
+    if (outputCount > code.size()) {
+      return prefix; // all outputs match
     }
 
-    // Try out all possible values for X = A & 0x7 (lower 3 bits)
-    // We have output = ((X ^ 0x4) ^ (A >> (X ^ 0x1))) & 0x7
-    for (int X = 0; X < 8; ++X) {
-      // The question is now: which A can satisfy the following condition:
-      // output = ((X ^ 0x4) ^ (A >> (X ^ 0x1))) & 0x7
-      //        = ((X ^ 0x4) & 0x7)  ^  ((A >> (X ^ 0x1)) & 0x7)
-      //        =  (X ^ 0x4) ^ ((A >> (X ^ 0x1)) & 0x7)
-      // output ^ X ^ 0x4 = (A >> (X ^ 0x1)) & 0x7
-      // requiredAX = (A >> (X ^ 0x1)) & 0x7
-      auto requiredAX = *pos ^ X ^ 0x4;
-      int64_t A = (currentA << 3 | X);
-      
+    // Try out all possible values for the next lower 3 bits
+    for (int group = 0; group < 8; ++group) {
+      int64_t A = prefix << 3 | group;
       // only follow the path if the output matches
-      if (((A >> (X^0x1)) & 0x7) == requiredAX) {
-        if (auto result = reverseSearchHelp(pos + 1, end, A)) {
+      if (A != 0 && vm.outputsCodeSuffix(A, reg, outputCount)) {
+        if (auto result = reverseSearchHelp(vm, outputCount + 1, A); result >= 0) {
           return result;
         }
       }
     }
-
-    return 0; // not found
+    return -1; // not found
   }
 
+  /** Runs the program with the given A (B and C from the given registers) and checks whether it outputs exactly the
+   *  last count values of its own code.
+   */
+  bool outputsCodeSuffix(int64_t A, const Register& initial, size_t count) {
+    reg = initial;
+    reg.A = A;
 
-
-  int64_t reverseSearch() {
-    auto reverseCode = code;
-    std::reverse(reverseCode.begin(), reverseCode.end());
-    return reverseSearchHelp(reverseCode.data(), reverseCode.data() + reverseCode.size(), 0);
+    // each loop iteration outputs one value, so give the program just enough steps to output one value too many
+    run(static_cast<int>(code.size() / 2 * (count + 1)));
+    return output.size() == count && std::ranges::equal(output, code | std::views::drop(code.size() - count));
   }
 
 
-
-
-
-
   int run(int maxSteps = std::numeric_limits<int>::max()) {
     output.clear();
     reg.IP = 0;
@@ -147,15 +141,20 @@ struct ProgramState {
 
 
   void adv(int operand) {
-    reg.A = reg.A / (1 << combo(operand));
+    reg.A = divide(reg.A, combo(operand));
   }
 
   void bdv(int operand) {
-    reg.B = reg.A / (1 << combo(operand));
+    reg.B = divide(reg.A, combo(operand));
   }
 
   void cdv(int operand) {
-    reg.C = reg.A / (1 << combo(operand));
+    reg.C = divide(reg.A, combo(operand));
+  }
+
+  // A / 2^exponent (the registers are never negative, so this is a shift which must not exceed the register width)
+  static int64_t divide(int64_t value, int64_t exponent) {
+    return exponent < 63 ? value >> exponent : 0;
   }
 
   void bxl(int operand) {
@@ -177,11 +176,11 @@ struct ProgramState {
   }
 
   void out(int operand) {
-    output.push_back(combo(operand) % 8);
+    output.push_back(static_cast<int>(combo(operand) % 8));
   }
 
   // resolves a combo operand to a literal one
-  int combo(int operand) const {
+  int64_t combo(int operand) const {
     if (operand <= 3) {
       return operand;
     }
@@ -195,14 +194,342 @@ struct ProgramState {
 
 
 
-  struct Register {
-    int A = 0, B = 0, C = 0, IP = 0;
-  } reg;
-
+  Register reg;
   std::vector<int> code;
   std::vector<int> output;
 };
 
+/** Pre-decoded version of a program for fast repeated execution (e.g. brute force searches).
+ *  Every code position is decoded once into a handler specialized for its opcode and operand, so executing an
+ *  instruction is a single indirect call without decoding, dispatch switch or combo operand switch.
+ *  Positions are decoded at every code index (not only even ones), so even odd jump targets behave like in the interpreter.
+ */
+struct CompiledProgram {
+  struct Machine {
+    int64_t A = 0, B = 0, C = 0;
+    std::vector<int> output;
+    const std::vector<int>* expected = nullptr; // if set, execution halts as soon as the output deviates from it
+  };
+
+  // Executes one instruction and returns the position of the next one
+  using Handler = size_t(*)(Machine& machine, size_t ip);
+
+  static const size_t Halt = std::numeric_limits<size_t>::max();
+
+  CompiledProgram(const std::vector<int>& code) {
+    static const auto table = handlerTable(std::make_integer_sequence<int, 8>());
+    for (size_t ip = 0; ip + 1 < code.size(); ++ip) {
+      handlers.push_back(table[code[ip]][code[ip + 1]]);
+    }
+  }
+
+  /** Runs the program on the machine, returns the number of executed instructions
+   */
+  size_t run(Machine& machine, size_t maxSteps = std::numeric_limits<size_t>::max()) const {
+    size_t step = 0;
+    for (size_t ip = 0; ip < handlers.size() && step < maxSteps; ++step) {
+      ip = handlers[ip](machine, ip);
+    }
+    return step;
+  }
+
+  /** Checks whether the program outputs its own code for the given A. Stops at the first deviating output.
+   */
+  bool isQuine(int64_t A, const ProgramState::Register& initial, const std::vector<int>& code, Machine& machine) const {
+    machine.A = A;
+    machine.B = initial.B;
+    machine.C = initial.C;
+    machine.output.clear();
+    machine.expected = &code;
+    run(machine, code.size() * code.size()); // enough for one loop iteration per output
+    return machine.output == code;
+  }
+
+private:
+  template<int Operand>
+  static int64_t combo(const Machine& machine) {
+    if constexpr (Operand <= 3) {
+      return Operand;
+    } else if constexpr (Operand == 4) {
+      return machine.A;
+    } else if constexpr (Operand == 5) {
+      return machine.B;
+    } else if constexpr (Operand == 6) {
+      return machine.C;
+    } else {
+      throw std::exception("malformed program!");
+    }
+  }
+
+  template<int Opcode, int Operand>
+  static size_t execute(Machine& machine, size_t ip) {
+    if constexpr (Opcode == 0) {
+      machine.A = ProgramState::divide(machine.A, combo<Operand>(machine));
+    } else if constexpr (Opcode == 1) {
+      machine.B ^= Operand;
+    } else if constexpr (Opcode == 2) {
+      machine.B = combo<Operand>(machine) % 8;
+    } else if constexpr (Opcode == 3) {
+      return machine.A ? Operand : ip + 2;
+    } else if constexpr (Opcode == 4) {
+      machine.B ^= machine.C;
+    } else if constexpr (Opcode == 5) {
+      auto value = static_cast<int>(combo<Operand>(machine) % 8);
+      machine.output.push_back(value);
+      if (machine.expected) {
+        auto& expected = *machine.expected;
+        if (machine.output.size() > expected.size() || expected[machine.output.size() - 1] != value) {
+          return Halt; // output mismatch
+        }
+      }
+    } else if constexpr (Opcode == 6) {
+      machine.B = ProgramState::divide(machine.A, combo<Operand>(machine));
+    } else if constexpr (Opcode == 7) {
+      machine.C = ProgramState::divide(machine.A, combo<Operand>(machine));
+    }
+    return ip + 2;
+  }
+
+  template<int Opcode, int... Operands>
+  static constexpr std::array<Handler, 8> opcodeHandlers(std::integer_sequence<int, Operands...>) {
+    return { &execute<Opcode, Operands>... };
+  }
+
+  template<int... Opcodes>
+  static constexpr std::array<std::array<Handler, 8>, 8> handlerTable(std::integer_sequence<int, Opcodes...>) {
+    return { opcodeHandlers<Opcodes>(std::make_integer_sequence<int, 8>())... };
+  }
+
+  std::vector<Handler> handlers; // per code position
+};
+
+
+#if BRUTE_FORCE
+/** Evaluates the program for Lanes consecutive values of A at once.
+ *  All lanes execute the same instruction in lockstep on per-lane register arrays, so each instruction becomes a short
+ *  loop over the lanes which the compiler vectorizes (the variable shifts map directly to AVX2). This only works if the
+ *  lanes can't take different paths through the program, which is the case if the only jump ever executed is the last
+ *  instruction: lanes with A == 0 end there, all others jump to the same target. Lanes that have ended or produced a
+ *  wrong output are masked out, and the evaluation stops as soon as no lane is left.
+ */
+template<int Lanes>
+struct LaneEvaluator {
+  static_assert(Lanes <= 32, "lane masks are 32 bit");
+  static const uint32_t AllLanes = Lanes == 32 ? ~0u : (1u << Lanes) - 1;
+
+  LaneEvaluator(const std::vector<int>& code, const ProgramState::Register& initial) : code(code), initial(initial) {}
+
+  bool lockstepPossible() const {
+    // all positions we can reach: the even ones from the start and the ones from any jump target
+    for (size_t start : { size_t(0), jumpTarget() }) {
+      for (size_t ip = start; ip + 1 < code.size(); ip += 2) {
+        if (code[ip] == 3 && ip != code.size() - 2) {
+          return false; // a jump other than at the end
+        }
+        bool comboOperand = code[ip] != 1 && code[ip] != 3 && code[ip] != 4;
+        if (comboOperand && code[ip + 1] == 7) {
+          return false; // malformed combo operand, leave that to the scalar version
+        }
+      }
+    }
+    return true;
+  }
+
+  /** Returns a mask of all lanes for which the program outputs its own code (lane i evaluates A = firstA + i)
+   */
+  uint32_t evaluate(int64_t firstA) const {
+    alignas(64) std::array<int64_t, Lanes> A, B, C, literal;
+    for (int lane = 0; lane < Lanes; ++lane) {
+      A[lane] = firstA + lane;
+      B[lane] = initial.B;
+      C[lane] = initial.C;
+    }
+
+    uint32_t active = AllLanes;
+    uint32_t quines = 0;
+    size_t outputIndex = 0; // same for all active lanes
+    size_t maxSteps = code.size() * code.size(); // enough for one loop iteration per output
+
+    size_t ip = 0;
+    for (size_t step = 0; active && step < maxSteps; ++step) {
+      if (ip + 1 >= code.size()) {
+        if (outputIndex == code.size()) {
+          quines |= active; // program ended with the complete output
+        }
+        break;
+      }
+
+      auto operand = code[ip + 1];
+      const int64_t* combo = literal.data();
+      switch (operand) {
+        case 4: combo = A.data(); break;
+        case 5: combo = B.data(); break;
+        case 6: combo = C.data(); break;
+        default: literal.fill(operand); break;
+      }
+
+      switch (code[ip]) {
+        case 0:
+          for (int lane = 0; lane < Lanes; ++lane) A[lane] = ProgramState::divide(A[lane], combo[lane]);
+          break;
+        case 1:
+          for (int lane = 0; lane < Lanes; ++lane) B[lane] ^= operand;
+          break;
+        case 2:
+          for (int lane = 0; lane < Lanes; ++lane) B[lane] = combo[lane] % 8;
+          break;
+        case 3: {
+          uint32_t ended = 0;
+          for (int lane = 0; lane < Lanes; ++lane) ended |= uint32_t(A[lane] == 0) << lane;
+          ended &= active;
+          if (outputIndex == code.size()) {
+            quines |= ended;
+          }
+          active &= ~ended;
+          ip = operand;
+          continue;
+        }
+        case 4:
+          for (int lane = 0; lane < Lanes; ++lane) B[lane] ^= C[lane];
+          break;
+        case 5: {
+          if (outputIndex == code.size()) {
+            active = 0; // output too long for all remaining lanes
+            break;
+          }
+          uint32_t mismatches = 0;
+          int64_t expected = code[outputIndex++];
+          for (int lane = 0; lane < Lanes; ++lane) mismatches |= uint32_t(combo[lane] % 8 != expected) << lane;
+          active &= ~mismatches;
+          break;
+        }
+        case 6:
+          for (int lane = 0; lane < Lanes; ++lane) B[lane] = ProgramState::divide(A[lane], combo[lane]);
+          break;
+        case 7:
+          for (int lane = 0; lane < Lanes; ++lane) C[lane] = ProgramState::divide(A[lane], combo[lane]);
+          break;
+      }
+      ip += 2;
+    }
+
+    return quines;
+  }
+
+  size_t jumpTarget() const {
+    return code.size() >= 2 && code[code.size() - 2] == 3 ? code.back() : 0;
+  }
+
+  const std::vector<int>& code;
+  ProgramState::Register initial;
+};
+
+
+/** Brute force search for the lowest A in [first, last) for which the program outputs its own code.
+ *  Chunks of consecutive values are handed out to all threads, each evaluating Lanes values at once. Programs which
+ *  can't be run in lockstep are checked value by value with the compiled program instead.
+ *  Returns -1 if no value in the range works.
+ */
+template<int Lanes>
+int64_t bruteForceQuine(const std::vector<int>& code, const ProgramState::Register& initial, int64_t first, int64_t last) {
+  const int64_t ChunkSize = Lanes * 4096;
+  const int64_t ProgressInterval = 10000000000;
+
+  LaneEvaluator<Lanes> evaluator(code, initial);
+  CompiledProgram compiled(code);
+  bool lockstep = evaluator.lockstepPossible();
+
+  std::atomic<int64_t> nextChunk = first;
+  std::atomic<int64_t> best = std::numeric_limits<int64_t>::max();
+
+  auto search = [&]() {
+    CompiledProgram::Machine machine;
+    for (;;) {
+      auto chunk = nextChunk.fetch_add(ChunkSize);
+      if (chunk >= last || chunk >= best) {
+        return; // everything below has been handed out or a lower value has been found
+      }
+      if (chunk / ProgressInterval != (chunk + ChunkSize) / ProgressInterval) {
+        std::cout << (chunk + ChunkSize) << "\n";
+      }
+
+      auto chunkEnd = std::min(chunk + ChunkSize, last);
+      for (auto A = chunk; A < chunkEnd; A += Lanes) {
+        uint32_t quines = 0;
+        if (lockstep) {
+          quines = evaluator.evaluate(A);
+        } else {
+          for (int lane = 0; lane < Lanes; ++lane) {
+            try {
+              quines |= uint32_t(compiled.isQuine(A + lane, initial, code, machine)) << lane;
+            } catch (const std::exception&) {
+              // malformed program for this value -> no quine
+            }
+          }
+        }
+        if (chunkEnd - A < Lanes) {
+          quines &= (1u << (chunkEnd - A)) - 1; // lanes beyond the range
+        }
+
+        if (quines) {
+          auto found = A + std::countr_zero(quines);
+          for (auto current = best.load(); found < current && !best.compare_exchange_weak(current, found););
+          return; // all higher values in this chunk don't matter and later chunks are even higher
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned thread = 0; thread < std::max(1u, std::thread::hardware_concurrency()); ++thread) {
+    threads.emplace_back(search);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  return best == std::numeric_limits<int64_t>::max() ? -1 : best.load();
+}
+#endif
+
+
+#if BENCHMARK
+// Compares the interpreter against the compiled program on consecutive register values
+void benchmarkExecution(const ProgramState& program) {
+  const int64_t N = 1000000;
+  const int64_t FirstA = int64_t(1) << 45; // long enough outputs for a realistic mix of instructions
+
+  auto measure = [](const char* name, auto&& func) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    int64_t steps = 0;
+    for (int64_t A = FirstA; A < FirstA + N; ++A) {
+      steps += func(A);
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto seconds = std::chrono::duration<double>(t2 - t1).count();
+    std::cout << name << ": " << (steps / seconds / 1e6) << "M steps/s, " << (N / seconds / 1e6) << "M runs/s\n";
+  };
+
+  auto interpreted = program;
+  measure("interpreted", [&](int64_t A) {
+    interpreted.reg = program.reg;
+    interpreted.reg.A = A;
+    return static_cast<int64_t>(interpreted.run());
+  });
+
+  CompiledProgram compiled(program.code);
+  CompiledProgram::Machine machine;
+  measure("compiled", [&](int64_t A) {
+    machine.A = A;
+    machine.B = program.reg.B;
+    machine.C = program.reg.C;
+    machine.output.clear(); // keeps the capacity, so the runs don't measure allocations
+    return static_cast<int64_t>(compiled.run(machine));
+  });
+}
+#endif
+
+
 std::ostream& operator<<(std::ostream& out, const std::vector<int>& vec) {
   for (auto it = vec.begin(), end = vec.end(); it != end; ) {
     out << *it;
@@ -230,32 +557,17 @@ int main()
   // Part 1 finished after 72 steps, so lets limit the program to 1000 steps and simply try all values
 
 #if BRUTE_FORCE
-  // The optimized brute force solution can check ~300.000.000 register values per second,
-  // but this is still nowehere fast enough to find the solution in a reasonable time.
-  // The value is where I got after letting this run for 1,5h, so a reasonable time estimate 
-  // would be 150h of runtime to find the value.
-  int64_t regAValue = 1460300000000; 
-  int64_t printCounter = 0;
-  while (program.output != program.code) {
-    ++regAValue;
-    ++printCounter;
-    if (regAValue < 0) {
-      throw std::exception("not found!");
-    }
-
-    if (program.fastRunOpti(regAValue)) {
-      break; // found the value
-    }
-
-    if (printCounter == 100000000) {
-      std::cout << regAValue << "\n";
-      printCounter = 0;
-    }
-  }
+  // The optimized scalar brute force solution could check ~300.000.000 register values per second,
+  // which is nowhere fast enough to find the solution in a reasonable time (estimated 150h for my input).
+  // Evaluating 16 values in lockstep on all cores is a lot faster, but the structural reverse search below
+  // remains the only practical solution. This is the baseline for programs where the reverse search doesn't apply.
+  auto bruteForceA = bruteForceQuine<16>(program.code, registerCopy, 1, std::numeric_limits<int64_t>::max());
+  std::cout << "Brute force: " << bruteForceA << "\n";
 #endif
 
   // Simply performing a recursive search by assembling the bits from the output in 
   // reverse order is actually the only way to solve this in a reasonable time
+  program.reg = registerCopy;
   auto A = program.reverseSearch();
 
 
@@ -264,4 +576,9 @@ int main()
   std::cout << "Part 1: " << part1Output << "\n";
   std::cout << "Part 2: " << A << "\n";
   std::cout << "Time " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << "ms\n";
+
+#if BENCHMARK
+  program.reg = registerCopy;
+  benchmarkExecution(program);
+#endif
 }
@@ -3,34 +3,20 @@
 #include <iostream>
 #include <chrono>
 
-#include <set>
-#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <limits>
 
 #include <common/field.hpp>
 #include <common/task.hpp>
 
 
-struct ExpandEntry {
-  ExpandEntry(Vector pos, int cost) : position(pos), cost(cost) {}
+const Vector MEMORY_SIZE(71, 71);
+const int FALLEN_BYTES = 1024; // for part 1
 
-  // Entries are ordered based on their cost to expand the low cost entries first
-  // We must include the position as well because we use an std::set<> and 
-  // we would otherwise not include expand entries for different positions if they have the same costs
-  std::strong_ordering operator<=>(const ExpandEntry& other) const {
-    auto result = cost <=> other.cost;
-    if (result == std::strong_ordering::equal) {
-      result = position <=> other.position;
-    }
-    return result;
-  }
-
-
-  Vector position;
-  int cost; // up until that position on the current path
-};
 
 struct MemorySpace : public Field {
-  MemorySpace(std::istream&& input) : Field(71,71, '.') {
+  MemorySpace(std::istream&& input, Vector size = MEMORY_SIZE) : Field(size.x, size.y, '.') {
     Vector pos;
     char sep;
     while (input >> pos.x >> sep >> pos.y) {
@@ -38,91 +24,193 @@ struct MemorySpace : public Field {
     }
   }
 
-  // Part 1
-  std::set<Vector> findPath() {
-    const Vector from = topLeft();
-    const Vector to = bottomRight();
-
-    // simple dijkstra
-    costMap.clear();
-    std::set<ExpandEntry> expandList = { {from, 0} };
-    while (!expandList.empty()) {
-      auto entry = *expandList.begin();
-      expandList.erase(expandList.begin());
-
-      if (!updateCosts(entry)) {
-        // DO not expand this node, because we already know a cheaper (or equally expensive) path to this node
-        // which thus has already been expanded
-        continue;
+  // Lets the given number of bytes fall into the memory space
+  void dropBytes(int count) {
+    for (int i = 0; i < count; ++i) {
+      (*this)[bytePositions[i]] = '#';
+    }
+  }
+
+  /** Part 1: Unit cost BFS from the top left to the bottom right corner, returns the number of steps (-1 if blocked).
+   *  All buffers are reused between calls: the distances are only valid for cells stamped with the current generation,
+   *  so nothing needs to be cleared or allocated for another search. The path itself is only collected by onPath().
+   */
+  int findPath() {
+    const int cellCount = static_cast<int>(data.size());
+    if (distances.size() != data.size()) {
+      distances.assign(cellCount, 0);
+      generations.assign(cellCount, 0);
+      queue.assign(cellCount, 0);
+    }
+    ++generation;
+
+    const int from = static_cast<int>(toOffset(topLeft()));
+    const int to = static_cast<int>(toOffset(bottomRight()));
+    if (data[from] == '#' || data[to] == '#') {
+      return -1;
+    }
+
+    // Ring buffer queue: every cell is enqueued at most once, so it can never overflow
+    size_t head = 0, tail = 0;
+    auto push = [&](int offset, int distance) {
+      distances[offset] = distance;
+      generations[offset] = generation;
+      queue[tail] = offset;
+      if (++tail == queue.size()) {
+        tail = 0;
       }
+    };
 
-      if (entry.position == to) {
-        // We are expanding the end tile -> we are done expanding
-        break;
+    push(from, 0);
+    while (head != tail) {
+      auto offset = queue[head];
+      if (++head == queue.size()) {
+        head = 0;
+      }
+      if (offset == to) {
+        break; // BFS reaches each cell with its minimal distance first
       }
 
-      // We have 4 paths to expand one in each direction
-      for (auto direction : Vector::AllSimpleDirections()) {
-        auto nextPosition = entry.position + direction;
-        if (validPosition(nextPosition) && (*this)[nextPosition] != '#') {
-          // No wall -> we can expand in that direction
-          expandList.insert({ nextPosition, entry.cost + 1 });
+      forEachNeighbour(offset, [&](int neighbour) {
+        if (data[neighbour] != '#' && generations[neighbour] != generation) {
+          push(neighbour, distances[offset] + 1);
         }
+      });
+    }
+
+    if (generations[to] != generation) {
+      return -1; // no path found
+    }
+
+    return distances[to];
+  }
+
+  // Whether the position is part of the path found by the last call to findPath()
+  bool onPath(const Vector& pos) {
+    if (pathBits.empty() || pathGeneration != generation) {
+      collectPath();
+    }
+    auto offset = toOffset(pos);
+    return (pathBits[offset / 64] >> (offset % 64)) & 1;
+  }
+
+  // Greedily collects ONE cheapest path of the last search into the path bitmap (stays empty if there is none)
+  void collectPath() {
+    pathBits.assign((data.size() + 63) / 64, 0);
+    pathGeneration = generation;
+
+    const int from = static_cast<int>(toOffset(topLeft()));
+    const int to = static_cast<int>(toOffset(bottomRight()));
+    if (generation == 0 || generations[to] != generation) {
+      return; // no search yet or no path found
+    }
+
+    for (int offset = to; ; ) {
+      pathBits[offset / 64] |= uint64_t(1) << (offset % 64);
+      if (offset == from) {
+        break;
       }
+
+      int previous = offset;
+      forEachNeighbour(offset, [&](int neighbour) {
+        if (generations[neighbour] == generation && distances[neighbour] == distances[offset] - 1) {
+          previous = neighbour;
+        }
+      });
+      offset = previous;
+    }
+  }
+
+  void forEachNeighbour(int offset, auto func) const {
+    auto column = offset % size.x;
+    if (column > 0) func(offset - 1);
+    if (column < size.x - 1) func(offset + 1);
+    if (offset >= size.x) func(offset - size.x);
+    if (offset + size.x < static_cast<int>(data.size())) func(offset + size.x);
+  }
+
+  /** Part 2: Finds the index of the first byte which cuts off the exit (or -1 if the exit stays reachable).
+   *  Instead of searching a path after each byte, this works backwards in time: starting with all bytes fallen, the
+   *  bytes are removed again in reverse order, joining each freed cell with its free neighbours in a disjoint set.
+   *  The first removal connecting start and exit is the byte we are looking for.
+   */
+  int findBlockingByte() {
+    // index of the first byte falling onto each cell (max if none)
+    std::vector<int> fallIndex(data.size(), std::numeric_limits<int>::max());
+    for (int i = static_cast<int>(bytePositions.size()) - 1; i >= 0; --i) {
+      fallIndex[toOffset(bytePositions[i])] = i;
     }
 
-    // Now greedily collect ONE cheapest path
-    std::set<Vector> path;
-    
-    if (costMap.find(to) == costMap.end()) {
-      return path; // no path found -> return empty set to signal this
+    cellRoots.resize(data.size());
+    for (int offset = 0; offset < static_cast<int>(data.size()); ++offset) {
+      cellRoots[offset] = offset;
     }
-    
-    int cost = getCost(to);
-    for (Vector pos = to; pos != from; ) {
-      path.insert(pos);
 
+    auto isFree = [&](int offset, int time) { return fallIndex[offset] >= time; }; // before byte[time] fell
+    auto freeCell = [&](int offset, int time) {
+      auto pos = fromOffset(offset);
       for (auto direction : Vector::AllSimpleDirections()) {
-        auto prevPos = pos + direction;
-        auto prevCost = getCost(prevPos);
-        if (prevCost < cost) {
-          cost = prevCost;
-          pos = prevPos;
-          break; // found the next step in the cheapest path
+        auto neighbour = pos + direction;
+        if (validPosition(neighbour) && isFree(toOffset(neighbour), time)) {
+          unite(offset, static_cast<int>(toOffset(neighbour)));
         }
       }
+    };
+
+    const int start = static_cast<int>(toOffset(topLeft()));
+    const int exit = static_cast<int>(toOffset(bottomRight()));
+    const int byteCount = static_cast<int>(bytePositions.size());
+
+    // State after all bytes have fallen
+    for (int offset = 0; offset < static_cast<int>(data.size()); ++offset) {
+      if (isFree(offset, byteCount)) {
+        freeCell(offset, byteCount);
+      }
     }
+    if (findRoot(start) == findRoot(exit)) {
+      return -1; // never blocked
+    }
+
+    for (int i = byteCount - 1; i >= 0; --i) {
+      auto offset = static_cast<int>(toOffset(bytePositions[i]));
+      if (fallIndex[offset] != i) {
+        continue; // another byte already fell onto this cell earlier
+      }
 
-    path.insert(from);
-    return path;
+      freeCell(offset, i);
+      if (isFree(start, i) && isFree(exit, i) && findRoot(start) == findRoot(exit)) {
+        return i; // before this byte fell, there was a path
+      }
+    }
+    return -1; // blocked from the beginning
   }
 
-  
-  int getCost(Vector position) const {
-    auto pos = costMap.find(position);
-    return (pos != costMap.end()) ? pos->second : std::numeric_limits<int>::max();
+  int findRoot(int offset) {
+    while (cellRoots[offset] != offset) {
+      cellRoots[offset] = cellRoots[cellRoots[offset]]; // path halving
+      offset = cellRoots[offset];
+    }
+    return offset;
   }
 
-  /** Add new/lower costs to each position or return false if the cost map already
-   *  contains lower costs
-   */
-  bool updateCosts(ExpandEntry& fromEntry) {
-    auto pos = costMap.find(fromEntry.position);
-    if (pos != costMap.end()) {
-      if (pos->second <= fromEntry.cost) {
-        return false; // no update to more expensive path
-      } else {
-        pos->second = fromEntry.cost;
-      }
-    } else {
-      // new path with yet unknown cost
-      costMap.emplace(fromEntry.position, fromEntry.cost);
+  void unite(int offset1, int offset2) {
+    auto root1 = findRoot(offset1);
+    auto root2 = findRoot(offset2);
+    if (root1 != root2) {
+      cellRoots[std::max(root1, root2)] = std::min(root1, root2);
     }
-    return true;
   }
 
   std::vector<Vector> bytePositions;
-  std::unordered_map<Vector/*position*/, int/*cost*/> costMap;
+  std::vector<int> cellRoots; // disjoint set of connected free cells for part 2
+
+  // BFS buffers (reused for every search)
+  uint32_t generation = 0;
+  std::vector<uint32_t> generations; // search in which the distance of a cell has been set
+  std::vector<int> distances;
+  std::vector<int> queue;
+  std::vector<uint64_t> pathBits; // path of the search with pathGeneration
+  uint32_t pathGeneration = 0;
 };
 
 
@@ -134,36 +222,22 @@ int main()
   MemorySpace memSpace(task::input());
 
   // Part 1
-  for (int i = 0; i < 1024; ++i) {
-    memSpace[memSpace.bytePositions[i]] = '#';
-  }
-  auto minPath = memSpace.findPath();
-  auto minCost = minPath.size()-1; // the start position doesn't count as step
+  memSpace.dropBytes(FALLEN_BYTES);
+  auto minCost = memSpace.findPath();
 
 
   // Part 2: Brute force of simply performing dijskstra after each change takes ~ 3s
-  //         The smarter algorithm below will calculate the shortest path and only 
-  //         recalculate the path if a byte falls onto that shortest path to verify that
-  //         a shortest path still exists. This approach takes 60ms
-
-  Vector bytePos;
-  for (int i = 1024; i < memSpace.bytePositions.size(); ++i) {
-    bytePos = memSpace.bytePositions[i];
-    memSpace[bytePos] = '#';
-
-    if (minPath.contains(bytePos)) {
-      // The byte fell into the current minimal path -> recalculate the minimal path
-      // to ensure it still exists
-      minPath = memSpace.findPath();
-      if (minPath.empty()) {
-        break; // no path found!
-      }
-    }
-  }
+  //         Only recalculating the path if a byte falls onto the current shortest path took 60ms.
+  //         Going backwards in time with a disjoint set doesn't need any path search at all.
+  auto blockingByte = memSpace.findBlockingByte();
 
   auto t2 = std::chrono::high_resolution_clock::now();
 
   std::cout << "Part1: " << minCost << "\n";
-  std::cout << "Part2: " << bytePos << "\n";
+  if (blockingByte >= 0) {
+    std::cout << "Part2: " << memSpace.bytePositions[blockingByte] << "\n";
+  } else {
+    std::cout << "Part2: exit never gets blocked\n";
+  }
   std::cout << "Time " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << "ms\n";
 }
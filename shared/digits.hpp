@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <utility>
+
+namespace common {
+  // All powers of 10 representable as uint64_t (10^19 < 2^64 < 10^20)
+  constexpr std::array<uint64_t, 20> Pow10Table = [] {
+    std::array<uint64_t, 20> table = {};
+    uint64_t value = 1;
+    for (auto& entry : table) {
+      entry = value;
+      value *= 10;
+    }
+    return table;
+  }();
+
+  /** Returns 10^exponent for exponent in [0,19]
+   */
+  constexpr uint64_t pow10(int exponent) {
+    return Pow10Table[exponent];
+  }
+
+  /** Returns the number of decimal digits of value (0 has one digit).
+   *  Estimates log10 from the bit width (1233/4096 ~ log10(2)) and corrects the estimate with a single table lookup,
+   *  so there is neither a loop nor a floating point conversion involved.
+   */
+  constexpr int digitCount(uint64_t value) {
+    value |= 1; // 0 has one digit as well (doesn't affect any other comparison as powers of 10 are even)
+    int estimate = (std::bit_width(value) * 1233) >> 12;
+    return estimate + (value >= Pow10Table[estimate]);
+  }
+
+  /** Same as above for non-negative signed values
+   */
+  constexpr int digitCount(int64_t value) {
+    return digitCount(static_cast<uint64_t>(value));
+  }
+
+  /** Splits the decimal representation of value into its upper and lower half of digits.
+   *  For values with an odd number of digits the upper half is one digit shorter (1234 -> {12,34}, 12345 -> {12,345})
+   */
+  constexpr std::pair<uint64_t, uint64_t> splitDigits(uint64_t value) {
+    auto divisor = pow10(digitCount(value) / 2);
+    return { value / divisor, value % divisor };
+  }
+
+  /** Same as above for non-negative signed values
+   */
+  constexpr std::pair<int64_t, int64_t> splitDigits(int64_t value) {
+    auto [upper, lower] = splitDigits(static_cast<uint64_t>(value));
+    return { static_cast<int64_t>(upper), static_cast<int64_t>(lower) };
+  }
+}